@@ -0,0 +1,498 @@
+//
+//  benchmark.cpp
+//  PSIM
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include "benchmark.h"
+#include "psim.h"
+#include "primsAlgorithm.h"
+#include "graphGen.h"
+#include "psimKernels.h"
+
+BenchOptions::BenchOptions() {
+    procs = {2, 4, 8};
+    sizes = {1, 64, 1024, 4096};
+    elems = {1 << 16, 1 << 20};
+    verts = {64, 128, 256};
+    densities = {0.1, 0.5};
+    threads = {1};
+    reps = 20;
+    warmup = 2;
+    seed = 12345;
+    graph = "er";
+    format = "csv";
+}
+
+BenchResult::BenchResult() {
+    p = 0;
+    bytes = 0;
+    verts = 0;
+    density = 0.0;
+    reps = 0;
+    min_us = p50_us = p90_us = p99_us = mean_us = max_us = 0.0;
+    mbps = 0.0;
+    speedup = 0.0;
+    efficiency = 0.0;
+    placement = "none";
+    transport = "pipe";
+    threads = 1;
+}
+
+//------------------------------------------------------------------------------------------------
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Nearest-rank percentile of an ascending sample
+static double percentile(const std::vector<double>& sorted, double q) {
+    if(sorted.empty()) {
+        return 0.0;
+    }
+    size_t idx = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+//Fill the latency columns of 'r' from samples in microseconds
+static void summarize(std::vector<double> samples, BenchResult& r) {
+    std::sort(samples.begin(), samples.end());
+    r.reps = (int)samples.size();
+    if(samples.empty()) {
+        return;
+    }
+    r.min_us = samples.front();
+    r.max_us = samples.back();
+    r.p50_us = percentile(samples, 0.50);
+    r.p90_us = percentile(samples, 0.90);
+    r.p99_us = percentile(samples, 0.99);
+    double total = 0.0;
+    for(size_t i = 0; i < samples.size(); i++) {
+        total += samples[i];
+    }
+    r.mean_us = total / samples.size();
+    if(r.bytes > 0 && r.p50_us > 0.0) {
+        r.mbps = r.bytes / r.p50_us;   //bytes per microsecond == MB/s
+    }
+}
+
+/*
+ *  Rank 0 collects every rank's samples (ns, 64-bit: a repetition may take longer than
+ *  an int of nanoseconds holds) and summarizes the slowest rank's time per repetition
+ *  into 'r'
+ */
+static void gather_slowest(PSim& comm, const std::vector<long long>& ns, BenchResult& r) {
+    std::vector<std::string> frames = gather_frames(comm, 0, pack_frame(ns.data(), ns.size()));
+    if(comm.rank != 0) {
+        return;
+    }
+    std::vector<long long> slowest = ns;
+    for(int j = 1; j < comm.nprocs; j++) {
+        std::vector<long long> other;
+        unpack_frame(frames[j], other);
+        for(size_t i = 0; i < slowest.size() && i < other.size(); i++) {
+            slowest[i] = std::max(slowest[i], other[i]);
+        }
+    }
+    std::vector<double> samples;
+    for(size_t i = 0; i < slowest.size(); i++) {
+        samples.push_back(slowest[i] / 1000.0);
+    }
+    summarize(samples, r);
+}
+
+//------------------------------------------------------------------------------------------------
+/*
+ *  COLLECTIVES:
+ */
+
+/*
+ *  Run one collective on a fresh p-process PSim. 'size' is the number of ints each
+ *  process receives for sized collectives (scatter). Returns the payload in bytes.
+ */
+static long long run_collective(PSim& comm, const std::string& op, int size, std::vector<int>& scatterData) {
+    if(op == "one2all_broadcast") {
+        comm.one2all_broadcast(0, 42);
+        return sizeof(int) * (comm.nprocs - 1);
+    }
+    if(op == "one2all_scatter") {
+        comm.one2all_scatter(0, scatterData);
+        return (long long)sizeof(int) * size * comm.nprocs;
+    }
+    if(op == "all2one_collect") {
+        comm.all2one_collect(0, comm.rank);
+        return sizeof(int) * comm.nprocs;
+    }
+    if(op == "all2one_reduce") {
+        comm.all2one_reduce(0, comm.rank, sum);
+        return sizeof(int) * comm.nprocs;
+    }
+    if(op == "all2all_reduce") {
+        comm.all2all_reduce(comm.rank, sum);
+        return sizeof(int) * 2 * comm.nprocs;
+    }
+    if(op == "all2all_broadcast") {
+        comm.all2all_broadcast(comm.rank);
+        return (long long)sizeof(int) * (comm.nprocs + comm.nprocs * comm.nprocs);
+    }
+    comm.barrier();
+    return 0;
+}
+
+/*
+ *  Time 'op' on the ranks of 'comm'. Every rank times every repetition (each preceded
+ *  by a barrier); rank 0 gathers the per-rank samples and keeps the slowest rank's time.
+ */
+static BenchResult time_collective(PSim& comm, const std::string& op, int size, const BenchOptions& opts) {
+    BenchResult r;
+    r.bench = "collective";
+    r.op = op;
+    r.p = comm.nprocs;
+    r.placement = comm.placement.mapping_str(comm.cpuOf);
+    
+    std::vector<int> scatterData;
+    if(comm.rank == 0 && op == "one2all_scatter") {
+        scatterData.resize((size_t)size * comm.nprocs);
+        for(size_t i = 0; i < scatterData.size(); i++) {
+            scatterData[i] = (int)i;
+        }
+    }
+
+    for(int i = 0; i < opts.warmup; i++) {
+        comm.barrier();
+        run_collective(comm, op, size, scatterData);
+    }
+    std::vector<long long> ns(opts.reps);
+    for(int i = 0; i < opts.reps; i++) {
+        comm.barrier();
+        long long t0 = now_ns();
+        r.bytes = run_collective(comm, op, size, scatterData);
+        ns[i] = now_ns() - t0;
+    }
+
+    gather_slowest(comm, ns, r);
+    return r;
+}
+
+/*
+ *  Time 'op' on a fresh p-process PSim over pipes, or on a session of 'group' when
+ *  one is given. The forked ranks exit in the PSim destructor on the way out.
+ */
+static BenchResult time_collective(const std::string& op, int p, int size, const BenchOptions& opts, RankGroup* group) {
+    if(group == NULL) {
+        PSim comm(p, SWITCH);
+        return time_collective(comm, op, size, opts);
+    }
+    PSim comm(*group, SWITCH);
+    BenchResult r = time_collective(comm, op, size, opts);
+    r.transport = group->transport;
+    return r;
+}
+
+/*
+ *  Sweep every collective over opts.procs. Only one2all_scatter carries a variable
+ *  payload, so it is the only one swept over opts.sizes; the int-valued collectives
+ *  are timed once per p. With a 'group' (a launched SocketMesh) p is fixed to its size
+ *  and every rank must call this; only rank 0's results are meaningful.
+ */
+void bench_collectives(const BenchOptions& opts, std::vector<BenchResult>& results, RankGroup* group) {
+    const char* ops[] = {"one2all_broadcast", "one2all_scatter", "all2one_collect",
+                         "all2one_reduce", "all2all_reduce", "all2all_broadcast", "barrier"};
+    std::vector<int> procs = (group != NULL) ? std::vector<int>(1, group->nprocs) : opts.procs;
+    for(size_t pi = 0; pi < procs.size(); pi++) {
+        int p = procs[pi];
+        for(size_t oi = 0; oi < sizeof(ops) / sizeof(ops[0]); oi++) {
+            std::string op = ops[oi];
+            if(op == "one2all_scatter") {
+                for(size_t si = 0; si < opts.sizes.size(); si++) {
+                    results.push_back(time_collective(op, p, opts.sizes[si], opts, group));
+                }
+            }
+            else {
+                results.push_back(time_collective(op, p, 1, opts, group));
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+/*
+ *  KERNELS:
+ */
+
+/*
+ *  Time one kernel on the ranks of 'comm', each holding 'n' uniformly random ints.
+ *  Inputs the kernel consumes are rebuilt before the clock starts. The payload is
+ *  every rank's data, so MBps is the global sort/count/exchange throughput.
+ */
+static BenchResult time_kernel(PSim& comm, const std::string& op, int n, const BenchOptions& opts) {
+    BenchResult r;
+    r.bench = "kernel";
+    r.op = op;
+    r.p = comm.nprocs;
+    r.bytes = (long long)sizeof(int) * n * comm.nprocs;
+    r.placement = comm.placement.mapping_str(comm.cpuOf);
+
+    std::mt19937 rng(opts.seed + comm.rank);
+    std::vector<int> data(n);
+    for(int i = 0; i < n; i++) {
+        data[i] = (int)(rng() >> 1);
+    }
+
+    std::vector<long long> ns;
+    for(int i = 0; i < opts.warmup + opts.reps; i++) {
+        std::vector<int> input;
+        std::vector<std::string> parts;
+        if(op == "sample_sort") {
+            input = data;
+        }
+        else if(op == "all2all_personalized") {
+            for(int j = 0; j < comm.nprocs; j++) {
+                size_t begin = (size_t)n * j / comm.nprocs, end = (size_t)n * (j + 1) / comm.nprocs;
+                parts.push_back(pack_frame(data.data() + begin, end - begin));
+            }
+        }
+        comm.barrier();
+        long long t0 = now_ns();
+        if(op == "sample_sort") {
+            sample_sort(comm, std::move(input));
+        }
+        else if(op == "histogram") {
+            histogram(comm, data, 0, 2147483647, 1024);
+        }
+        else {
+            comm.all2all_personalized(std::move(parts));
+        }
+        if(i >= opts.warmup) {
+            ns.push_back(now_ns() - t0);
+        }
+    }
+
+    gather_slowest(comm, ns, r);
+    return r;
+}
+
+static BenchResult time_kernel(const std::string& op, int p, int n, const BenchOptions& opts, RankGroup* group) {
+    if(group == NULL) {
+        PSim comm(p, SWITCH);
+        return time_kernel(comm, op, n, opts);
+    }
+    PSim comm(*group, SWITCH);
+    BenchResult r = time_kernel(comm, op, n, opts);
+    r.transport = group->transport;
+    return r;
+}
+
+/*
+ *  Sample sort, histogram and the personalized all-to-all under them, over
+ *  opts.procs x opts.elems (ints per rank). With a 'group' p is fixed as for
+ *  bench_collectives.
+ */
+void bench_kernels(const BenchOptions& opts, std::vector<BenchResult>& results, RankGroup* group) {
+    const char* ops[] = {"all2all_personalized", "sample_sort", "histogram"};
+    std::vector<int> procs = (group != NULL) ? std::vector<int>(1, group->nprocs) : opts.procs;
+    for(size_t pi = 0; pi < procs.size(); pi++) {
+        for(size_t ei = 0; ei < opts.elems.size(); ei++) {
+            for(size_t oi = 0; oi < sizeof(ops) / sizeof(ops[0]); oi++) {
+                results.push_back(time_kernel(ops[oi], procs[pi], opts.elems[ei], opts, group));
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+/*
+ *  SESSIONS:
+ */
+
+/*
+ *  Cost of starting a p-process session and running one barrier on it: a standalone
+ *  PSim (pipes + fork + join every time) against a session carved from a RankPool
+ *  that was forked once.
+ */
+void bench_sessions(const BenchOptions& opts, std::vector<BenchResult>& results) {
+    for(size_t pi = 0; pi < opts.procs.size(); pi++) {
+        int p = opts.procs[pi];
+
+        BenchResult fork;
+        fork.bench = "session";
+        fork.op = "fork_session";
+        fork.p = p;
+        std::vector<double> samples;
+        for(int i = 0; i < opts.warmup + opts.reps; i++) {
+            long long t0 = now_ns();
+            {
+                PSim comm(p, SWITCH);
+                comm.barrier();
+                fork.placement = comm.placement.mapping_str(comm.cpuOf);
+            }
+            if(i >= opts.warmup) {
+                samples.push_back((now_ns() - t0) / 1000.0);
+            }
+        }
+        summarize(samples, fork);
+        results.push_back(fork);
+
+        BenchResult pooled;
+        pooled.bench = "session";
+        pooled.op = "pool_session";
+        pooled.p = p;
+        {
+            RankPool pool(p);
+            pooled.placement = pool.placement.mapping_str(pool.cpuOf);
+            std::vector<long long> ns;
+            for(int i = 0; i < opts.warmup + opts.reps; i++) {
+                long long t0 = now_ns();
+                {
+                    PSim comm(pool, SWITCH);
+                    comm.barrier();
+                }
+                if(i >= opts.warmup) {
+                    ns.push_back(now_ns() - t0);
+                }
+            }
+            PSim comm(pool, SWITCH);
+            gather_slowest(comm, ns, pooled);
+        }
+        results.push_back(pooled);
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+/*
+ *  PRIM:
+ */
+
+/*
+ *  The generator spec for one point of the sweep: opts.graph with n vertices and
+ *  density * n(n-1)/2 edges (at least a spanning tree's worth). Grids take the
+ *  nearest square/cube side instead.
+ */
+static GraphSpec sweep_spec(const BenchOptions& opts, int n, double density, unsigned seed) {
+    GraphSpec spec;
+    spec.parse(opts.graph);
+    spec.nVerts = n;
+    spec.nEdges = std::max((long long)(density * n * (n - 1) / 2.0), (long long)n - 1);
+    spec.seed = seed;
+    if(spec.kind == GRID2D) {
+        int side = (int)(sqrt((double)n) + 0.5);
+        spec.dims[0] = spec.dims[1] = side;
+        spec.nVerts = side * side;
+    }
+    else if(spec.kind == GRID3D) {
+        int side = (int)(cbrt((double)n) + 0.5);
+        spec.dims[0] = spec.dims[1] = spec.dims[2] = side;
+        spec.nVerts = side * side * side;
+    }
+    return spec;
+}
+
+/*
+ *  Time Prim::run() for one mode. For PARALLEL/DISTRIBUTED the fork of the PSim
+ *  processes happens inside run() and is part of the measured time; only rank 0
+ *  returns from run(). Each rank scans with 'threads' threads.
+ */
+static std::vector<double> time_prim(const GraphSpec& spec, PrimEnum mode, int p, int threads, const BenchOptions& opts) {
+    std::vector<double> samples;
+    Prim P(spec, mode, p, false);
+    P.nThreads = threads;
+    for(int i = 0; i < opts.warmup + opts.reps; i++) {
+        long long t0 = now_ns();
+        P.run();
+        double us = (now_ns() - t0) / 1000.0;
+        if(i >= opts.warmup) {
+            samples.push_back(us);
+        }
+    }
+    return samples;
+}
+
+//The mapping the PSim inside Prim::run() will choose for p ranks
+static std::string placement_of(int p) {
+    Placement placement = Placement::from_env();
+    return placement.mapping_str(placement.map(p, SWITCH));
+}
+
+/*
+ *  SEQUENTIAL vs PARALLEL vs DISTRIBUTED across opts.verts x opts.densities x opts.procs
+ */
+void bench_prim(const BenchOptions& opts, std::vector<BenchResult>& results) {
+    for(size_t vi = 0; vi < opts.verts.size(); vi++) {
+        for(size_t di = 0; di < opts.densities.size(); di++) {
+            int n = opts.verts[vi];
+            double density = opts.densities[di];
+            GraphSpec spec = sweep_spec(opts, n, density, opts.seed + (unsigned)(vi * 1000 + di));
+
+            BenchResult seq;
+            seq.bench = "prim";
+            seq.op = "prim_sequential";
+            seq.p = 1;
+            seq.verts = spec.nVerts;
+            seq.density = density;
+            summarize(time_prim(spec, SEQUENTIAL, 1, 1, opts), seq);
+            seq.speedup = 1.0;
+            seq.efficiency = 1.0;
+            results.push_back(seq);
+
+            PrimEnum modes[] = {PARALLEL, DISTRIBUTED};
+            const char* names[] = {"prim_parallel", "prim_distributed"};
+            for(int mi = 0; mi < 2; mi++) {
+                for(size_t pi = 0; pi < opts.procs.size(); pi++) {
+                    for(size_t ti = 0; ti < opts.threads.size(); ti++) {
+                        BenchResult r;
+                        r.bench = "prim";
+                        r.op = names[mi];
+                        r.p = opts.procs[pi];
+                        r.threads = opts.threads[ti];
+                        r.verts = spec.nVerts;
+                        r.density = density;
+                        r.placement = placement_of(r.p);
+                        summarize(time_prim(spec, modes[mi], r.p, r.threads, opts), r);
+                        if(r.p50_us > 0.0) {
+                            r.speedup = seq.p50_us / r.p50_us;
+                            r.efficiency = r.speedup / (r.p * r.threads);
+                        }
+                        results.push_back(r);
+                    }
+                }
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Write results as CSV (one header line) or as a JSON object tagged with the build
+ */
+void write_results(std::ostream& os, const std::vector<BenchResult>& results, const std::string& format) {
+    if(format == "json") {
+        os << "{\n  \"build\": \"" << __DATE__ << " " << __TIME__ << "\",\n  \"results\": [\n";
+        for(size_t i = 0; i < results.size(); i++) {
+            const BenchResult& r = results[i];
+            os << "    {\"bench\": \"" << r.bench << "\", \"op\": \"" << r.op << "\", \"p\": " << r.p
+               << ", \"bytes\": " << r.bytes << ", \"verts\": " << r.verts << ", \"density\": " << r.density
+               << ", \"reps\": " << r.reps << ", \"min_us\": " << r.min_us << ", \"p50_us\": " << r.p50_us
+               << ", \"p90_us\": " << r.p90_us << ", \"p99_us\": " << r.p99_us << ", \"mean_us\": " << r.mean_us
+               << ", \"max_us\": " << r.max_us << ", \"MBps\": " << r.mbps << ", \"speedup\": " << r.speedup
+               << ", \"efficiency\": " << r.efficiency << ", \"placement\": \"" << r.placement
+               << "\", \"transport\": \"" << r.transport << "\", \"threads\": " << r.threads << "}" << ((i + 1 < results.size()) ? "," : "") << "\n";
+        }
+        os << "  ]\n}" << std::endl;
+        return;
+    }
+    os << "bench,op,p,bytes,verts,density,reps,min_us,p50_us,p90_us,p99_us,mean_us,max_us,MBps,speedup,efficiency,placement,transport,threads\n";
+    for(size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        os << r.bench << "," << r.op << "," << r.p << "," << r.bytes << "," << r.verts << "," << r.density << ","
+           << r.reps << "," << r.min_us << "," << r.p50_us << "," << r.p90_us << "," << r.p99_us << ","
+           << r.mean_us << "," << r.max_us << "," << r.mbps << "," << r.speedup << "," << r.efficiency << ","
+           << "\"" << r.placement << "\"," << r.transport << "," << r.threads << "\n";
+    }
+    os.flush();
+}
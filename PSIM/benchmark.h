@@ -0,0 +1,76 @@
+//
+//  benchmark.h
+//  PSIM
+//
+//  Timing driver for the PSim collectives and for Prim's algorithm. Results are
+//  written as CSV or JSON so runs from different builds can be compared.
+//
+
+#ifndef __PSIM__benchmark__
+#define __PSIM__benchmark__
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct RankGroup;
+
+struct BenchOptions {
+    std::vector<int> procs;         //process counts p to sweep
+    std::vector<int> sizes;         //message sizes in ints (sized collectives only)
+    std::vector<int> elems;         //ints per rank for the sort/histogram kernels
+    std::vector<int> verts;         //graph sizes for the Prim benchmark
+    std::vector<double> densities;  //edge densities in (0, 1] for the Prim benchmark
+    std::vector<int> threads;       //threads per rank for PARALLEL/DISTRIBUTED Prim
+    int reps;                       //timed repetitions per configuration
+    int warmup;                     //untimed repetitions per configuration
+    unsigned seed;
+    std::string graph;              //generator spec for the Prim graphs (see graphGen.h)
+    std::string placement;          //rank placement policy (see psimPlacement.h), "" = PSIM_PLACEMENT
+    std::string format;             //"csv" or "json"
+
+    BenchOptions();
+};
+
+
+/*
+ *  One row of output. Latencies are in microseconds. For collectives every repetition
+ *  is timed on every rank and the slowest rank's time is the sample; bandwidth is the
+ *  payload moved divided by the median latency. speedup/efficiency are relative to the
+ *  SEQUENTIAL run of the same graph and are 0 where they do not apply. 'placement'
+ *  records where the ranks ran so a result can be reproduced, 'transport' what
+ *  carried the messages and 'threads' how many threads each rank ran.
+ */
+struct BenchResult {
+    std::string bench;
+    std::string op;
+    int p;
+    long long bytes;
+    int verts;
+    double density;
+    int reps;
+    double min_us;
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double mean_us;
+    double max_us;
+    double mbps;
+    double speedup;
+    double efficiency;
+    std::string placement;  //policy and CPU of every rank, e.g. "compact=0,1,2,3"
+    std::string transport;  //"pipe", or the socket transport of a launched run
+    int threads;            //threads per rank
+
+    BenchResult();
+};
+
+
+void bench_collectives(const BenchOptions& opts, std::vector<BenchResult>& results, RankGroup* group = NULL);
+void bench_kernels(const BenchOptions& opts, std::vector<BenchResult>& results, RankGroup* group = NULL);
+void bench_sessions(const BenchOptions& opts, std::vector<BenchResult>& results);
+void bench_prim(const BenchOptions& opts, std::vector<BenchResult>& results);
+void write_results(std::ostream& os, const std::vector<BenchResult>& results, const std::string& format);
+
+#endif /* defined(__PSIM__benchmark__) */
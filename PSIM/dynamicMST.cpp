@@ -0,0 +1,301 @@
+//
+//  dynamicMST.cpp
+//  PSIM
+//
+
+#include <climits>
+#include <algorithm>
+#include "dynamicMST.h"
+
+//Order-independent key of the undirected edge (u, v)
+static uint64_t pair_key(int u, int v) {
+    uint32_t a = static_cast<uint32_t>(std::min(u, v));
+    uint32_t b = static_cast<uint32_t>(std::max(u, v));
+    return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+/*
+ *  Empty forest over nVerts isolated vertices
+ */
+DynamicMST::DynamicMST(int nVerts) {
+    this->init(nVerts);
+}
+
+/*
+ *  Forest seeded with an existing MST, e.g. the output of Prim or StreamingMST
+ */
+DynamicMST::DynamicMST(int nVerts, const std::vector<Edge>& tree) {
+    this->init(nVerts);
+    for(std::vector<Edge>::const_iterator it = tree.begin(); it != tree.end(); it++) {
+        this->insert_edge(it->e[0], it->e[1], it->weight);
+    }
+}
+
+/*
+ *  Forest seeded with the MST computed by P.run()
+ */
+DynamicMST::DynamicMST(const Prim& P) {
+    this->init(P.nVerts);
+    for(size_t i = 0; i < P.T.size(); i++) {
+        this->insert_edge(P.T.u[i], P.T.v[i], P.T.w[i]);
+    }
+}
+
+void DynamicMST::init(int n) {
+    this->nVerts = n;
+    this->nTreeEdges = 0;
+    this->totalWeight = 0;
+
+    //vertices plus room for the at most n-1 tree edges
+    size_t cap = static_cast<size_t>(n) + (n > 0 ? n - 1 : 0);
+    ch[0].assign(cap, -1);
+    ch[1].assign(cap, -1);
+    par.assign(cap, -1);
+    rev.assign(cap, 0);
+    val.assign(cap, INT_MIN);
+    mx.resize(cap);
+    eu.assign(cap, -1);
+    ev.assign(cap, -1);
+    for(size_t i = 0; i < cap; i++) {
+        mx[i] = static_cast<int>(i);
+    }
+    for(size_t i = cap; i > static_cast<size_t>(n); i--) {
+        freeNodes.push_back(static_cast<int>(i - 1));
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+/*
+ *  LINK-CUT TREE PRIMITIVES:
+ */
+
+bool DynamicMST::is_root(int x) const {
+    int p = par[x];
+    return p == -1 || (ch[0][p] != x && ch[1][p] != x);
+}
+
+//Propagate a pending subtree reversal to the children of x
+void DynamicMST::push(int x) {
+    if(rev[x]) {
+        std::swap(ch[0][x], ch[1][x]);
+        if(ch[0][x] != -1) rev[ch[0][x]] ^= 1;
+        if(ch[1][x] != -1) rev[ch[1][x]] ^= 1;
+        rev[x] = 0;
+    }
+}
+
+//Recompute the path-max aggregate of x from its children
+void DynamicMST::pull(int x) {
+    mx[x] = x;
+    for(int d = 0; d < 2; d++) {
+        int c = ch[d][x];
+        if(c != -1 && val[mx[c]] > val[mx[x]]) {
+            mx[x] = mx[c];
+        }
+    }
+}
+
+void DynamicMST::rotate(int x) {
+    int p = par[x];
+    int g = par[p];
+    int d = (ch[1][p] == x) ? 1 : 0;
+    int b = ch[1-d][x];
+
+    if(!is_root(p)) {
+        ch[(ch[1][g] == p) ? 1 : 0][g] = x;
+    }
+    par[x] = g;
+
+    ch[1-d][x] = p;
+    par[p] = x;
+
+    ch[d][p] = b;
+    if(b != -1) par[b] = p;
+
+    pull(p);
+    pull(x);
+}
+
+void DynamicMST::splay(int x) {
+    //push pending reversals top-down along the splay path first
+    std::vector<int> path;
+    path.push_back(x);
+    for(int y = x; !is_root(y); y = par[y]) {
+        path.push_back(par[y]);
+    }
+    for(std::vector<int>::reverse_iterator it = path.rbegin(); it != path.rend(); it++) {
+        push(*it);
+    }
+
+    while(!is_root(x)) {
+        int p = par[x];
+        if(!is_root(p)) {
+            int g = par[p];
+            bool zigzig = (ch[0][g] == p) == (ch[0][p] == x);
+            rotate(zigzig ? p : x);
+        }
+        rotate(x);
+    }
+}
+
+//Make the root-to-x path preferred; afterwards x is the root of its splay tree
+void DynamicMST::access(int x) {
+    int last = -1;
+    for(int y = x; y != -1; y = par[y]) {
+        splay(y);
+        ch[1][y] = last;
+        pull(y);
+        last = y;
+    }
+    splay(x);
+}
+
+void DynamicMST::make_root(int x) {
+    access(x);
+    rev[x] ^= 1;
+}
+
+int DynamicMST::find_root(int x) {
+    access(x);
+    push(x);
+    while(ch[0][x] != -1) {
+        x = ch[0][x];
+        push(x);
+    }
+    splay(x);
+    return x;
+}
+
+void DynamicMST::link(int x, int y) {
+    make_root(x);
+    par[x] = y;
+}
+
+//Remove the tree edge between adjacent nodes x and y
+void DynamicMST::cut(int x, int y) {
+    make_root(x);
+    access(y);
+    push(y);
+    ch[0][y] = -1;
+    par[x] = -1;
+    pull(y);
+}
+
+//Node of the heaviest edge on the tree path u..v (u and v must be connected)
+int DynamicMST::path_max(int u, int v) {
+    make_root(u);
+    access(v);
+    return mx[v];
+}
+
+//------------------------------------------------------------------------------------------------
+
+int DynamicMST::new_edge_node(int u, int v, int w) {
+    int x = freeNodes.back();
+    freeNodes.pop_back();
+    ch[0][x] = ch[1][x] = par[x] = -1;
+    rev[x] = 0;
+    val[x] = w;
+    mx[x] = x;
+    eu[x] = u;
+    ev[x] = v;
+    return x;
+}
+
+void DynamicMST::link_edge(int u, int v, int w) {
+    int x = new_edge_node(u, v, w);
+    link(u, x);
+    link(x, v);
+    treeEdge[pair_key(u, v)] = x;
+    this->nTreeEdges++;
+    this->totalWeight += w;
+}
+
+void DynamicMST::cut_edge(int x) {
+    cut(eu[x], x);
+    cut(x, ev[x]);
+    treeEdge.erase(pair_key(eu[x], ev[x]));
+    this->nTreeEdges--;
+    this->totalWeight -= val[x];
+    val[x] = INT_MIN;
+    freeNodes.push_back(x);
+}
+
+bool DynamicMST::connected(int u, int v) {
+    return u == v || find_root(u) == find_root(v);
+}
+
+/*
+ *  Insert the undirected edge (u, v) with weight w. Returns true if the forest changed.
+ *  Inserting an edge that is already in the tree only ever lowers its weight.
+ */
+bool DynamicMST::insert_edge(int u, int v, int w) {
+    if(u == v || u < 0 || v < 0 || u >= this->nVerts || v >= this->nVerts) {
+        return false;
+    }
+
+    std::unordered_map<uint64_t, int>::iterator found = treeEdge.find(pair_key(u, v));
+    if(found != treeEdge.end()) {
+        int x = found->second;
+        if(w >= val[x]) {
+            return false;
+        }
+        //x is the root of its splay tree after access, so its aggregate can be fixed in place
+        access(x);
+        this->totalWeight += static_cast<long long>(w) - val[x];
+        val[x] = w;
+        pull(x);
+        return true;
+    }
+
+    if(!connected(u, v)) {
+        link_edge(u, v, w);
+        return true;
+    }
+
+    int heaviest = path_max(u, v);
+    if(val[heaviest] <= w) {
+        return false;
+    }
+    cut_edge(heaviest);
+    link_edge(u, v, w);
+    return true;
+}
+
+/*
+ *  Lower the weight of edge (u, v) to w. Tree edges are updated in place; for a
+ *  non-tree edge this is exactly an insertion at the new weight.
+ */
+bool DynamicMST::decrease_weight(int u, int v, int w) {
+    return this->insert_edge(u, v, w);
+}
+
+/*
+ *  Apply a batch of insertions/decreases. Lighter updates are applied first, so
+ *  heavier ones in the same batch are more often rejected by a single path query
+ *  instead of causing a cut they would later undo. Returns the number of updates
+ *  that changed the forest.
+ */
+int DynamicMST::apply(std::vector<Edge> updates) {
+    std::sort(updates.begin(), updates.end(), [](const Edge& a, const Edge& b) { return a.weight < b.weight; });
+    int changed = 0;
+    for(std::vector<Edge>::iterator it = updates.begin(); it != updates.end(); it++) {
+        if(this->insert_edge(it->e[0], it->e[1], it->weight)) {
+            changed++;
+        }
+    }
+    return changed;
+}
+
+/*
+ *  The current forest as a list of Edges
+ */
+std::vector<Edge> DynamicMST::edges() const {
+    std::vector<Edge> out;
+    out.reserve(treeEdge.size());
+    for(std::unordered_map<uint64_t, int>::const_iterator it = treeEdge.begin(); it != treeEdge.end(); it++) {
+        int x = it->second;
+        out.push_back(Edge(eu[x], ev[x], val[x]));
+    }
+    return out;
+}
@@ -0,0 +1,78 @@
+//
+//  dynamicMST.h
+//  PSIM
+//
+//  Incremental maintenance of an MST under edge insertions and weight decreases.
+//
+
+#ifndef __PSIM__dynamicMST__
+#define __PSIM__dynamicMST__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include "primsAlgorithm.h"
+
+
+/*
+ *  Minimum spanning forest kept in a link-cut tree. Every tree edge is its own node
+ *  between its two endpoints, so the heaviest edge on any tree path is found with a
+ *  path aggregate in O(log V) amortized time.
+ *
+ *  Inserting (u, v, w):
+ *      u, v in different trees          -> link them with the new edge
+ *      max edge on the u..v path > w    -> cut that edge, link the new one
+ *      otherwise                        -> the new edge is the heaviest on its cycle; drop it
+ *
+ *  Lowering the weight of a non-tree edge is the same as inserting it at its new
+ *  weight, and a non-tree edge can never re-enter the tree through insertions or
+ *  decreases elsewhere, so non-tree edges are never stored.
+ */
+class DynamicMST {
+public:
+
+    DynamicMST(int nVerts);
+    DynamicMST(int nVerts, const std::vector<Edge>& tree);
+    DynamicMST(const Prim& P);
+
+    bool insert_edge(int u, int v, int w);
+    bool decrease_weight(int u, int v, int w);
+    int apply(std::vector<Edge> updates);
+    bool connected(int u, int v);
+    std::vector<Edge> edges() const;
+
+    int nVerts;
+    int nTreeEdges;
+    long long totalWeight;
+
+private:
+    void init(int n);
+    int new_edge_node(int u, int v, int w);
+    void link_edge(int u, int v, int w);
+    void cut_edge(int x);
+
+    //link-cut tree primitives over nodes [0, nVerts) = vertices, [nVerts, ...) = edges
+    bool is_root(int x) const;
+    void push(int x);
+    void pull(int x);
+    void rotate(int x);
+    void splay(int x);
+    void access(int x);
+    void make_root(int x);
+    int find_root(int x);
+    void link(int x, int y);
+    void cut(int x, int y);
+    int path_max(int u, int v);
+
+    std::vector<int> ch[2];
+    std::vector<int> par;
+    std::vector<char> rev;
+    std::vector<int> val;       //edge weight; INT_MIN for vertex nodes
+    std::vector<int> mx;        //node holding the max val in this splay subtree
+    std::vector<int> eu, ev;    //endpoints of edge nodes
+    std::vector<int> freeNodes; //recycled edge nodes
+    std::unordered_map<uint64_t, int> treeEdge;   //(min(u,v), max(u,v)) -> edge node
+};
+
+#endif /* defined(__PSIM__dynamicMST__) */
@@ -0,0 +1,90 @@
+//
+//  edgeArray.cpp
+//  PSIM
+//
+
+#include <algorithm>
+#include "edgeArray.h"
+
+void EdgeArray::push_back(int uIn, int vIn, int wIn) {
+    u.push_back(uIn);
+    v.push_back(vIn);
+    w.push_back(wIn);
+}
+
+void EdgeArray::push_back(const Edge& ed) {
+    this->push_back(ed.e[0], ed.e[1], ed.weight);
+}
+
+Edge EdgeArray::get(size_t i) const {
+    return Edge(u[i], v[i], w[i]);
+}
+
+EdgeKey EdgeArray::key(size_t i) const {
+    return pack_edge(u[i], v[i], w[i]);
+}
+
+size_t EdgeArray::size() const {
+    return w.size();
+}
+
+void EdgeArray::reserve(size_t n) {
+    u.reserve(n);
+    v.reserve(n);
+    w.reserve(n);
+}
+
+void EdgeArray::clear() {
+    u.clear();
+    v.clear();
+    w.clear();
+}
+
+/*
+ *  Stable sort by weight. Each edge becomes one 64-bit integer (biased weight in the
+ *  high half, original index in the low half), the integers are sorted, and the
+ *  three arrays are permuted once by the resulting index order.
+ */
+void EdgeArray::sort_by_weight() {
+    size_t n = this->size();
+    std::vector<uint64_t> order(n);
+    for(size_t i = 0; i < n; i++) {
+        uint64_t bw = static_cast<uint32_t>(w[i]) ^ 0x80000000u;
+        order[i] = (bw << 32) | static_cast<uint32_t>(i);
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<int> tmp(n);
+    std::vector<int>* cols[3] = {&u, &v, &w};
+    for(int c = 0; c < 3; c++) {
+        std::vector<int>& col = *cols[c];
+        for(size_t i = 0; i < n; i++) {
+            tmp[i] = col[static_cast<uint32_t>(order[i])];
+        }
+        col.swap(tmp);
+    }
+}
+
+long long EdgeArray::total_weight() const {
+    long long total = 0;
+    for(size_t i = 0; i < w.size(); i++) {
+        total += w[i];
+    }
+    return total;
+}
+
+std::vector<Edge> EdgeArray::edges() const {
+    std::vector<Edge> out;
+    out.reserve(this->size());
+    for(size_t i = 0; i < this->size(); i++) {
+        out.push_back(this->get(i));
+    }
+    return out;
+}
+
+std::ostream& operator<<(std::ostream & os, const EdgeArray& arr) {
+    for(size_t i = 0; i < arr.size(); i++) {
+        os << arr.get(i);
+    }
+    return os;
+}
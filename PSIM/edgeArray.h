@@ -0,0 +1,176 @@
+//
+//  edgeArray.h
+//  PSIM
+//
+//  Edge types: the Edge struct, a packed 64-bit sortable edge key, and the
+//  structure-of-arrays EdgeArray used to hold edge lists and MST output.
+//
+
+#ifndef __PSIM__edgeArray__
+#define __PSIM__edgeArray__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <functional>
+
+
+struct Edge {
+    int e[2];
+    int weight;
+    
+    //Default constructor
+    Edge() {
+        e[0] = 0;
+        e[1] = 0;
+        weight = 0;
+    }
+    
+    //Overload constructor
+    Edge(int u, int v, int w) {
+        e[0] = u;
+        e[1] = v;
+        weight = w;
+    }
+    
+    //Overloaded equality operator. Tests for cummutativity.
+    bool operator==(const Edge& a) const {
+        return (
+                (e[0] == a.e[0] && e[1] == a.e[1]) ||
+                (e[0] == a.e[1] && e[1] == a.e[0])
+                );
+    }
+    
+    friend std::ostream& operator<<(std::ostream & os, const Edge& ed) {
+        os << ed.e[0] << " " << ed.e[1] << " (" << ed.weight << ") " << std::endl;
+        return os;
+    }
+    
+    void set(int u, int v, int w) {
+        e[0] = u;
+        e[1] = v;
+        weight = w;
+    }
+    
+    //Make Edge serializable via Boost
+    template<typename Archive>
+    void serialize(Archive& ar, const unsigned int version) {
+        ar & e;
+        ar & weight;
+    }
+};
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  EdgeKey: an Edge packed into one unsigned 64-bit integer, ordered by weight first
+ *  and then by (u, v), so min/max/sort over edges are plain integer operations and
+ *  ties break identically on every process.
+ *
+ *      bits 63..40: weight + 2^23   (24 bits, signed weights in [-2^23, 2^23))
+ *      bits 39..20: u               (20 bits, vertices in [0, 2^20))
+ *      bits 19..0 : v               (20 bits)
+ *
+ *  EDGE_KEY_NONE is greater than every valid key, so it is the identity for a min
+ *  reduction and stands for "no candidate edge".
+ */
+typedef uint64_t EdgeKey;
+
+static const int EDGE_KEY_WEIGHT_BITS = 24;
+static const int EDGE_KEY_VERTEX_BITS = 20;
+static const int EDGE_KEY_MAX_VERTS = 1 << EDGE_KEY_VERTEX_BITS;
+static const int EDGE_KEY_MIN_WEIGHT = -(1 << (EDGE_KEY_WEIGHT_BITS - 1));
+static const int EDGE_KEY_MAX_WEIGHT = (1 << (EDGE_KEY_WEIGHT_BITS - 1)) - 1;
+static const EdgeKey EDGE_KEY_NONE = ~static_cast<EdgeKey>(0);
+
+//No range check: callers holding arbitrary edges test packable() first (PSim's Edge
+//collectives fall back to a full Edge archive, Prim refuses the graph)
+inline EdgeKey pack_edge(int u, int v, int w) {
+    const EdgeKey vmask = (static_cast<EdgeKey>(1) << EDGE_KEY_VERTEX_BITS) - 1;
+    EdgeKey bw = static_cast<EdgeKey>(static_cast<int64_t>(w) - EDGE_KEY_MIN_WEIGHT);
+    return (bw << (2 * EDGE_KEY_VERTEX_BITS)) |
+           ((static_cast<EdgeKey>(u) & vmask) << EDGE_KEY_VERTEX_BITS) |
+           (static_cast<EdgeKey>(v) & vmask);
+}
+
+inline EdgeKey pack_edge(const Edge& ed) {
+    return pack_edge(ed.e[0], ed.e[1], ed.weight);
+}
+
+inline int key_u(EdgeKey k) {
+    return static_cast<int>((k >> EDGE_KEY_VERTEX_BITS) & ((1u << EDGE_KEY_VERTEX_BITS) - 1));
+}
+
+inline int key_v(EdgeKey k) {
+    return static_cast<int>(k & ((1u << EDGE_KEY_VERTEX_BITS) - 1));
+}
+
+inline int key_weight(EdgeKey k) {
+    return static_cast<int>(static_cast<int64_t>(k >> (2 * EDGE_KEY_VERTEX_BITS)) + EDGE_KEY_MIN_WEIGHT);
+}
+
+inline Edge unpack_edge(EdgeKey k) {
+    return Edge(key_u(k), key_v(k), key_weight(k));
+}
+
+//True if the edge (u, v, w) survives a round trip through an EdgeKey
+inline bool packable(int u, int v, int w) {
+    return u >= 0 && u < EDGE_KEY_MAX_VERTS && v >= 0 && v < EDGE_KEY_MAX_VERTS &&
+           w >= EDGE_KEY_MIN_WEIGHT && w <= EDGE_KEY_MAX_WEIGHT;
+}
+
+//------------------------------------------------------------------------------------------------
+
+//64-bit finalizer (splitmix64) used to spread edge keys over hash buckets
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/*
+ *  Hash function for Edge objects (for use in unordered containers). The endpoints
+ *  are ordered first, matching Edge::operator==, and the pair is mixed as one 64-bit
+ *  value so edges with equal endpoint sums no longer collide.
+ */
+struct HashEdge {
+    size_t operator()(const Edge &edge) const{
+        uint32_t a = static_cast<uint32_t>(edge.e[0] < edge.e[1] ? edge.e[0] : edge.e[1]);
+        uint32_t b = static_cast<uint32_t>(edge.e[0] < edge.e[1] ? edge.e[1] : edge.e[0]);
+        return static_cast<size_t>(mix64((static_cast<uint64_t>(a) << 32) | b));
+    }
+};
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Structure-of-arrays edge list. Endpoints and weights live in separate contiguous
+ *  int arrays; sorting goes through 64-bit (weight, index) integer keys.
+ */
+class EdgeArray {
+public:
+
+    void push_back(int u, int v, int w);
+    void push_back(const Edge& ed);
+    Edge get(size_t i) const;
+    EdgeKey key(size_t i) const;
+    size_t size() const;
+    void reserve(size_t n);
+    void clear();
+
+    void sort_by_weight();
+    long long total_weight() const;
+    std::vector<Edge> edges() const;
+
+    friend std::ostream& operator<<(std::ostream & os, const EdgeArray& arr);
+
+    std::vector<int> u;
+    std::vector<int> v;
+    std::vector<int> w;
+};
+
+#endif /* defined(__PSIM__edgeArray__) */
@@ -0,0 +1,189 @@
+//
+//  edgeStream.cpp
+//  PSIM
+//
+
+#include <cstring>
+#include "edgeStream.h"
+
+/*
+ *  Open 'filename' and read its header. The BINARY format is recognised by its
+ *  magic bytes, anything else is parsed as the TEXT format.
+ */
+EdgeStream::EdgeStream(const char* filename) {
+    this->nVerts = 0;
+    this->nEdges = 0;
+    this->edgesRead = 0;
+    this->bytesRead = 0;
+    this->format = EdgeFormat::TEXT;
+    this->ok = false;
+
+    this->fp = fopen(filename, "rb");
+    if(this->fp == NULL) {
+        std::cerr << "EdgeStream: cannot open " << filename << std::endl;
+        return;
+    }
+
+    char magic[4];
+    if(fread(magic, 1, 4, this->fp) == 4 && memcmp(magic, EDGE_STREAM_MAGIC, 4) == 0) {
+        int32_t version, nv, reserved;
+        int64_t ne;
+        if(fread(&version, sizeof(version), 1, this->fp) != 1 ||
+           fread(&nv, sizeof(nv), 1, this->fp) != 1 ||
+           fread(&reserved, sizeof(reserved), 1, this->fp) != 1 ||
+           fread(&ne, sizeof(ne), 1, this->fp) != 1 ||
+           version != EDGE_STREAM_VERSION) {
+            std::cerr << "EdgeStream: bad header in " << filename << std::endl;
+            return;
+        }
+        this->format = EdgeFormat::BINARY;
+        this->nVerts = nv;
+        this->nEdges = ne;
+        this->bytesRead = EDGE_STREAM_HEADER_BYTES;
+    }
+    else {
+        rewind(this->fp);
+        if(fscanf(this->fp, "%d %lld", &this->nVerts, &this->nEdges) != 2) {
+            std::cerr << "EdgeStream: bad header in " << filename << std::endl;
+            return;
+        }
+        this->bytesRead = static_cast<unsigned long long>(ftell(this->fp));
+    }
+    this->ok = true;
+}
+
+EdgeStream::~EdgeStream() {
+    if(this->fp != NULL) {
+        fclose(this->fp);
+    }
+}
+
+bool EdgeStream::good() const {
+    return this->ok;
+}
+
+/*
+ *  Append up to maxEdges further edges from the file to 'chunk'. Returns the number
+ *  of edges appended; 0 once the stream is exhausted. Binary records are staged
+ *  through a fixed-size buffer so the reader itself stays within a small footprint.
+ */
+size_t EdgeStream::read(std::vector<Edge>& chunk, size_t maxEdges) {
+    if(!this->ok) {
+        return 0;
+    }
+    long long left = this->nEdges - this->edgesRead;
+    size_t want = (static_cast<long long>(maxEdges) < left) ? maxEdges : static_cast<size_t>(left);
+    size_t n = 0;
+    bool bad = false;
+
+    if(this->format == EdgeFormat::BINARY) {
+        this->rawBuf.resize(3 * EDGE_STREAM_BLOCK);
+        while(n < want && !bad) {
+            size_t block = (want - n < EDGE_STREAM_BLOCK) ? (want - n) : EDGE_STREAM_BLOCK;
+            size_t got = fread(this->rawBuf.data(), 3 * sizeof(int32_t), block, this->fp);
+            size_t kept = 0;
+            for(; kept < got; kept++) {
+                const int32_t* rec = &this->rawBuf[3 * kept];
+                if(!this->in_range(rec[0], rec[1])) {
+                    bad = true;
+                    break;
+                }
+                chunk.push_back(Edge(rec[0], rec[1], rec[2]));
+            }
+            n += kept;
+            this->bytesRead += kept * 3 * sizeof(int32_t);
+            if(got < block) {
+                break;
+            }
+        }
+    }
+    else {
+        long before = ftell(this->fp);
+        int u, v, w;
+        while(n < want && fscanf(this->fp, "%d %d %d", &u, &v, &w) == 3) {
+            if(!this->in_range(u, v)) {
+                bad = true;
+                break;
+            }
+            chunk.push_back(Edge(u, v, w));
+            n++;
+        }
+        this->bytesRead += static_cast<unsigned long long>(ftell(this->fp) - before);
+    }
+
+    //a short read means the file holds fewer edges than its header claims; a vertex
+    //outside [0, nVerts) means it is corrupt. Either way nothing after it is used.
+    if(bad) {
+        std::cerr << "EdgeStream: edge " << this->edgesRead + n << " has a vertex outside [0, "
+                  << this->nVerts << ")" << std::endl;
+    }
+    if(n < want) {
+        this->ok = false;
+    }
+    this->edgesRead += n;
+    return n;
+}
+
+//Both endpoints are vertices of the graph
+bool EdgeStream::in_range(int u, int v) const {
+    return u >= 0 && u < this->nVerts && v >= 0 && v < this->nVerts;
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Create 'filename' and write a BINARY header with a placeholder edge count.
+ */
+EdgeStreamWriter::EdgeStreamWriter(const char* filename, int nVerts) {
+    this->nVerts = nVerts;
+    this->nEdges = 0;
+    this->bytesWritten = 0;
+
+    this->fp = fopen(filename, "wb");
+    if(this->fp == NULL) {
+        std::cerr << "EdgeStreamWriter: cannot open " << filename << std::endl;
+        return;
+    }
+    int32_t version = EDGE_STREAM_VERSION, nv = nVerts, reserved = 0;
+    int64_t ne = 0;
+    fwrite(EDGE_STREAM_MAGIC, 1, 4, this->fp);
+    fwrite(&version, sizeof(version), 1, this->fp);
+    fwrite(&nv, sizeof(nv), 1, this->fp);
+    fwrite(&reserved, sizeof(reserved), 1, this->fp);
+    fwrite(&ne, sizeof(ne), 1, this->fp);
+    this->bytesWritten = EDGE_STREAM_HEADER_BYTES;
+}
+
+EdgeStreamWriter::~EdgeStreamWriter() {
+    this->close();
+}
+
+void EdgeStreamWriter::write(const Edge& edge) {
+    if(this->fp == NULL) {
+        return;
+    }
+    int32_t rec[3] = {edge.e[0], edge.e[1], edge.weight};
+    fwrite(rec, sizeof(int32_t), 3, this->fp);
+    this->nEdges++;
+    this->bytesWritten += sizeof(rec);
+}
+
+void EdgeStreamWriter::write(const std::vector<Edge>& edges) {
+    for(std::vector<Edge>::const_iterator it = edges.begin(); it != edges.end(); it++) {
+        this->write(*it);
+    }
+}
+
+/*
+ *  Patch the final edge count into the header and close the file.
+ */
+void EdgeStreamWriter::close() {
+    if(this->fp == NULL) {
+        return;
+    }
+    int64_t ne = this->nEdges;
+    fseek(this->fp, 16, SEEK_SET);
+    fwrite(&ne, sizeof(ne), 1, this->fp);
+    fclose(this->fp);
+    this->fp = NULL;
+}
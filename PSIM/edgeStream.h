@@ -0,0 +1,92 @@
+//
+//  edgeStream.h
+//  PSIM
+//
+//  Sequential readers/writers for edge-list files that are too large to be loaded
+//  at once. Two on-disk formats are understood:
+//
+//  TEXT:   the format read by Prim -- "nVerts nEdges" followed by nEdges lines of "u v w"
+//  BINARY: a 24 byte header followed by nEdges packed int32 (u, v, w) records
+//
+//          offset  0: char[4]  magic "PSEB"
+//          offset  4: int32    format version (1)
+//          offset  8: int32    nVerts
+//          offset 12: int32    reserved (0)
+//          offset 16: int64    nEdges
+//
+
+#ifndef __PSIM__edgeStream__
+#define __PSIM__edgeStream__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include "primsAlgorithm.h"
+
+
+enum EdgeFormat {
+    TEXT,
+    BINARY
+};
+
+
+/*
+ *  Forward-only reader over an edge-list file. The format is detected from the first
+ *  bytes of the file. Edges are appended to a caller-owned vector in caller-sized
+ *  chunks so only one chunk needs to be resident at a time.
+ */
+class EdgeStream {
+public:
+
+    EdgeStream(const char* filename);
+    ~EdgeStream();
+
+    size_t read(std::vector<Edge>& chunk, size_t maxEdges);
+    bool good() const;
+
+    EdgeFormat format;
+    int nVerts;
+    long long nEdges;
+    long long edgesRead;
+    unsigned long long bytesRead;
+
+private:
+    bool in_range(int u, int v) const;
+
+    FILE *fp;
+    bool ok;
+    std::vector<int32_t> rawBuf;   //staging buffer for binary records
+};
+
+
+/*
+ *  Writer for the BINARY format. nEdges in the header is patched on close(), so
+ *  edges may be appended without knowing the final count up front.
+ */
+class EdgeStreamWriter {
+public:
+
+    EdgeStreamWriter(const char* filename, int nVerts);
+    ~EdgeStreamWriter();
+
+    void write(const Edge& edge);
+    void write(const std::vector<Edge>& edges);
+    void close();
+
+    int nVerts;
+    long long nEdges;
+    unsigned long long bytesWritten;
+
+private:
+    FILE *fp;
+};
+
+
+static const char EDGE_STREAM_MAGIC[4] = {'P', 'S', 'E', 'B'};
+static const int EDGE_STREAM_VERSION = 1;
+static const long EDGE_STREAM_HEADER_BYTES = 24;
+static const size_t EDGE_STREAM_BLOCK = 4096;   //binary records staged per fread
+
+#endif /* defined(__PSIM__edgeStream__) */
@@ -0,0 +1,443 @@
+//
+//  graphGen.cpp
+//  PSIM
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "graphGen.h"
+#include "edgeStream.h"
+#include "psim.h"
+#include "psimKernels.h"
+
+//Independent random streams drawn from the same seed
+static const uint64_t STREAM_PERMUTE = 1;
+static const uint64_t STREAM_RMAT = 2;
+static const uint64_t STREAM_POINTS = 3;
+static const uint64_t STREAM_WEIGHT = 4;
+
+GraphSpec::GraphSpec() {
+    kind = ERDOS_RENYI;
+    nVerts = 1024;
+    nEdges = 8192;
+    dims[0] = 32;
+    dims[1] = 32;
+    dims[2] = 1;
+    a = 0.57;
+    b = 0.19;
+    c = 0.19;
+    weights = WEIGHT_UNIFORM;
+    minWeight = 1;
+    maxWeight = 1000;
+    weightMean = 0.0;
+    seed = 12345;
+    connected = true;
+}
+
+/*
+ *  Parse "kind[,key=value]..." where kind is er, rmat, grid2d, grid3d or geo and the
+ *  keys are n, m, dims (e.g. 100x100x10), a, b, c, weights (uniform|exp|distance),
+ *  wmin, wmax, wmean, seed and connected (0|1). Unset fields keep their defaults.
+ *  Returns false on anything unrecognised.
+ */
+bool GraphSpec::parse(const std::string& text) {
+    std::stringstream ss(text);
+    std::string item;
+    bool first = true;
+    while(std::getline(ss, item, ',')) {
+        if(first) {
+            first = false;
+            if(item == "er")            kind = ERDOS_RENYI;
+            else if(item == "rmat")     kind = RMAT;
+            else if(item == "grid2d")   kind = GRID2D;
+            else if(item == "grid3d")   kind = GRID3D;
+            else if(item == "geo")      kind = GEOMETRIC;
+            else return false;
+            continue;
+        }
+        size_t eq = item.find('=');
+        if(eq == std::string::npos) {
+            return false;
+        }
+        std::string key = item.substr(0, eq), value = item.substr(eq + 1);
+        if(key == "n")              nVerts = atoi(value.c_str());
+        else if(key == "m")         nEdges = atoll(value.c_str());
+        else if(key == "a")         a = atof(value.c_str());
+        else if(key == "b")         b = atof(value.c_str());
+        else if(key == "c")         c = atof(value.c_str());
+        else if(key == "wmin")      minWeight = atoi(value.c_str());
+        else if(key == "wmax")      maxWeight = atoi(value.c_str());
+        else if(key == "wmean")     weightMean = atof(value.c_str());
+        else if(key == "seed")      seed = strtoull(value.c_str(), NULL, 10);
+        else if(key == "connected") connected = (atoi(value.c_str()) != 0);
+        else if(key == "weights") {
+            if(value == "uniform")          weights = WEIGHT_UNIFORM;
+            else if(value == "exp")         weights = WEIGHT_EXPONENTIAL;
+            else if(value == "distance")    weights = WEIGHT_DISTANCE;
+            else return false;
+        }
+        else if(key == "dims") {
+            dims[0] = dims[1] = dims[2] = 1;
+            std::stringstream ds(value);
+            std::string d;
+            for(int i = 0; i < 3 && std::getline(ds, d, 'x'); i++) {
+                dims[i] = atoi(d.c_str());
+            }
+        }
+        else {
+            return false;
+        }
+    }
+    return !first;
+}
+
+std::string GraphSpec::str() const {
+    const char* kinds[] = {"er", "rmat", "grid2d", "grid3d", "geo"};
+    const char* dists[] = {"uniform", "exp", "distance"};
+    std::ostringstream os;
+    os << kinds[kind];
+    if(kind == GRID2D) {
+        os << ",dims=" << dims[0] << "x" << dims[1];
+    }
+    else if(kind == GRID3D) {
+        os << ",dims=" << dims[0] << "x" << dims[1] << "x" << dims[2];
+    }
+    else {
+        os << ",n=" << nVerts << ",m=" << nEdges;
+    }
+    if(kind == RMAT) {
+        os << ",a=" << a << ",b=" << b << ",c=" << c;
+    }
+    os << ",weights=" << dists[weights] << ",wmin=" << minWeight << ",wmax=" << maxWeight;
+    if(weights == WEIGHT_EXPONENTIAL && weightMean > 0.0) {
+        os << ",wmean=" << weightMean;
+    }
+    os << ",seed=" << seed << ",connected=" << (connected ? 1 : 0);
+    return os.str();
+}
+
+std::ostream& operator<<(std::ostream& os, const GraphSpec& spec) {
+    os << spec.str();
+    return os;
+}
+
+//------------------------------------------------------------------------------------------------
+
+GraphGenerator::GraphGenerator(const GraphSpec& specIn) {
+    this->spec = specIn;
+    this->nPairs = 0;
+    this->feistelHalf = 1;
+    this->scale = 0;
+    this->radius = 0.0;
+    this->nCells = 1;
+
+    //Weights must be nonzero (0 means "no edge" in Prim's matrix) and fit an EdgeKey
+    spec.minWeight = std::max(1, std::min(spec.minWeight, EDGE_KEY_MAX_WEIGHT));
+    spec.maxWeight = std::max(spec.minWeight, std::min(spec.maxWeight, EDGE_KEY_MAX_WEIGHT));
+
+    if(spec.kind == GRID2D || spec.kind == GRID3D) {
+        if(spec.kind == GRID2D) {
+            spec.dims[2] = 1;
+        }
+        for(int i = 0; i < 3; i++) {
+            spec.dims[i] = std::max(1, spec.dims[i]);
+        }
+        spec.nVerts = spec.dims[0] * spec.dims[1] * spec.dims[2];
+        spec.connected = false;     //already connected
+    }
+    this->nVerts = std::max(0, spec.nVerts);
+    this->pathSlots = (spec.connected && this->nVerts > 1) ? this->nVerts - 1 : 0;
+    long long n = this->nVerts;
+
+    if(spec.kind == ERDOS_RENYI) {
+        //Edge i is pair number permute(i) of the n(n-1)/2 possible pairs, so the m
+        //edges are distinct without any coordination between ranks
+        this->nPairs = n * (n - 1) / 2;
+        spec.nEdges = std::max(0LL, std::min(spec.nEdges, this->nPairs));
+        int bits = 1;
+        while(bits < 62 && (1LL << bits) < this->nPairs) {
+            bits++;
+        }
+        this->feistelHalf = (bits + 1) / 2;
+        for(int r = 0; r < 4; r++) {
+            this->feistelKeys[r] = counter_rng(spec.seed, STREAM_PERMUTE, r);
+        }
+    }
+    else if(spec.kind == RMAT) {
+        spec.nEdges = (n > 1) ? std::max(0LL, spec.nEdges) : 0;
+        while((1LL << this->scale) < n) {
+            this->scale++;
+        }
+    }
+    else if(spec.kind == GEOMETRIC) {
+        //E[edges] = n(n-1)/2 * pi r^2 (ignoring the boundary)
+        if(n > 1) {
+            this->radius = std::min(sqrt(2.0 * spec.nEdges / (M_PI * n * (n - 1))), M_SQRT2);
+        }
+        int maxCells = static_cast<int>(sqrt(static_cast<double>(n))) + 1;
+        this->nCells = (this->radius > 0.0) ? std::max(1, std::min(static_cast<int>(1.0 / this->radius), maxCells)) : 1;
+
+        px.resize(this->nVerts);
+        py.resize(this->nVerts);
+        std::vector<int> cellOf(this->nVerts);
+        cellStart.assign(static_cast<size_t>(this->nCells) * this->nCells + 1, 0);
+        for(int i = 0; i < this->nVerts; i++) {
+            px[i] = unit_double(counter_rng(spec.seed, STREAM_POINTS, 2 * static_cast<uint64_t>(i)));
+            py[i] = unit_double(counter_rng(spec.seed, STREAM_POINTS, 2 * static_cast<uint64_t>(i) + 1));
+            int cx = std::min(static_cast<int>(px[i] * this->nCells), this->nCells - 1);
+            int cy = std::min(static_cast<int>(py[i] * this->nCells), this->nCells - 1);
+            cellOf[i] = cy * this->nCells + cx;
+            cellStart[cellOf[i] + 1]++;
+        }
+        for(size_t k = 1; k < cellStart.size(); k++) {
+            cellStart[k] += cellStart[k - 1];
+        }
+        //counting sort keeps each cell in ascending vertex order
+        std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+        cellPoints.resize(this->nVerts);
+        for(int i = 0; i < this->nVerts; i++) {
+            cellPoints[fill[cellOf[i]]++] = i;
+        }
+    }
+}
+
+/*
+ *  Size of the slot space: the spanning path first, then one slot per edge
+ *  (ERDOS_RENYI, RMAT) or per source vertex (GRID, GEOMETRIC).
+ */
+long long GraphGenerator::slots() const {
+    if(spec.kind == ERDOS_RENYI || spec.kind == RMAT) {
+        return this->pathSlots + spec.nEdges;
+    }
+    return this->pathSlots + this->nVerts;
+}
+
+/*
+ *  Append the edges of slots [begin, end) to 'out'
+ */
+void GraphGenerator::generate(long long begin, long long end, EdgeArray& out) const {
+    end = std::min(end, this->slots());
+    for(long long s = begin; s < end; s++) {
+        if(s < this->pathSlots) {
+            int u = static_cast<int>(s);
+            int w = (spec.kind == GEOMETRIC && spec.weights == WEIGHT_DISTANCE) ? this->distance_weight(u, u + 1) : this->weight(u, u + 1);
+            out.push_back(u, u + 1, w);
+            continue;
+        }
+        long long i = s - this->pathSlots;
+        switch(spec.kind) {
+            case ERDOS_RENYI:   this->edge_er(i, out); break;
+            case RMAT:          this->edge_rmat(i, out); break;
+            case GRID2D:
+            case GRID3D:        this->edges_grid(static_cast<int>(i), out); break;
+            case GEOMETRIC:     this->edges_geometric(static_cast<int>(i), out); break;
+        }
+    }
+}
+
+/*
+ *  Append the edges of rank's block of the slot space when it is split among nprocs
+ */
+void GraphGenerator::generate_partition(int rankIn, int nprocs, EdgeArray& out) const {
+    long long total = this->slots();
+    long long begin = total * rankIn / nprocs;
+    long long end = total * (rankIn + 1) / nprocs;
+    this->generate(begin, end, out);
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Weight of edge {u, v}: a function of the unordered pair only, so a pair generated
+ *  twice (e.g. by the spanning path and the graph proper) gets the same weight.
+ */
+int GraphGenerator::weight(int u, int v) const {
+    uint64_t lo = static_cast<uint32_t>(std::min(u, v)), hi = static_cast<uint32_t>(std::max(u, v));
+    uint64_t x = counter_rng(spec.seed, STREAM_WEIGHT, (lo << 32) | hi);
+    long long range = static_cast<long long>(spec.maxWeight) - spec.minWeight;
+    if(spec.weights == WEIGHT_EXPONENTIAL) {
+        double mean = (spec.weightMean > 0.0) ? spec.weightMean : std::max(range / 8.0, 1.0);
+        double w = spec.minWeight - log(1.0 - unit_double(x)) * mean;
+        return static_cast<int>(std::min(w, static_cast<double>(spec.maxWeight)));
+    }
+    return spec.minWeight + static_cast<int>(x % static_cast<uint64_t>(range + 1));
+}
+
+/*
+ *  GEOMETRIC with WEIGHT_DISTANCE: weight proportional to the length of {u, v}, from
+ *  minWeight at distance 0 to maxWeight at 'radius'. Spanning path edges longer than
+ *  the radius get maxWeight; one that also comes out as a graph edge gets the same
+ *  weight both times.
+ */
+int GraphGenerator::distance_weight(int u, int v) const {
+    double dx = px[v] - px[u], dy = py[v] - py[u];
+    double d = (this->radius > 0.0) ? std::min(sqrt(dx * dx + dy * dy) / this->radius, 1.0) : 1.0;
+    return spec.minWeight + static_cast<int>((spec.maxWeight - spec.minWeight) * d);
+}
+
+/*
+ *  i-th G(n, m) edge. A 4-round Feistel network keyed by the seed permutes
+ *  [0, 2^(2*feistelHalf)); cycle-walking restricts it to a permutation of [0, nPairs),
+ *  and the pair index is unranked as p = v(v-1)/2 + u with u < v.
+ */
+void GraphGenerator::edge_er(long long i, EdgeArray& out) const {
+    const uint64_t mask = (static_cast<uint64_t>(1) << this->feistelHalf) - 1;
+    uint64_t x = static_cast<uint64_t>(i);
+    do {
+        uint64_t L = x >> this->feistelHalf, R = x & mask;
+        for(int r = 0; r < 4; r++) {
+            uint64_t F = mix64(R ^ this->feistelKeys[r]) & mask;
+            uint64_t next = L ^ F;
+            L = R;
+            R = next;
+        }
+        x = (L << this->feistelHalf) | R;
+    } while(x >= static_cast<uint64_t>(this->nPairs));
+
+    long long p = static_cast<long long>(x);
+    long long v = static_cast<long long>((1.0 + sqrt(1.0 + 8.0 * static_cast<double>(p))) / 2.0);
+    while(v * (v - 1) / 2 > p) {
+        v--;
+    }
+    while((v + 1) * v / 2 <= p) {
+        v++;
+    }
+    int u = static_cast<int>(p - v * (v - 1) / 2);
+    out.push_back(u, static_cast<int>(v), this->weight(u, static_cast<int>(v)));
+}
+
+/*
+ *  i-th R-MAT edge: descend 'scale' levels of the adjacency matrix choosing a quadrant
+ *  with probabilities a, b, c, d. Ids beyond n (n not a power of two) wrap around and
+ *  a self loop is redirected to the next vertex, so every slot yields exactly one edge.
+ */
+void GraphGenerator::edge_rmat(long long i, EdgeArray& out) const {
+    long long u = 0, v = 0;
+    for(int level = 0; level < this->scale; level++) {
+        double r = unit_double(counter_rng(spec.seed, STREAM_RMAT, static_cast<uint64_t>(i) * this->scale + level));
+        int bu = (r >= spec.a + spec.b) ? 1 : 0;
+        int bv = (r >= spec.a && r < spec.a + spec.b) || (r >= spec.a + spec.b + spec.c) ? 1 : 0;
+        u = 2 * u + bu;
+        v = 2 * v + bv;
+    }
+    u %= this->nVerts;
+    v %= this->nVerts;
+    if(u == v) {
+        v = (v + 1) % this->nVerts;
+    }
+    out.push_back(static_cast<int>(u), static_cast<int>(v), this->weight(static_cast<int>(u), static_cast<int>(v)));
+}
+
+//Lattice edges from u to its +x, +y and +z neighbours
+void GraphGenerator::edges_grid(int u, EdgeArray& out) const {
+    int X = spec.dims[0], Y = spec.dims[1], Z = spec.dims[2];
+    int x = u % X, y = (u / X) % Y, z = u / (X * Y);
+    if(x + 1 < X) out.push_back(u, u + 1, this->weight(u, u + 1));
+    if(y + 1 < Y) out.push_back(u, u + X, this->weight(u, u + X));
+    if(z + 1 < Z) out.push_back(u, u + X * Y, this->weight(u, u + X * Y));
+}
+
+//Edges from u to every v > u within 'radius', found in the 3x3 block of cells around u
+void GraphGenerator::edges_geometric(int u, EdgeArray& out) const {
+    int cx = std::min(static_cast<int>(px[u] * this->nCells), this->nCells - 1);
+    int cy = std::min(static_cast<int>(py[u] * this->nCells), this->nCells - 1);
+    double r2 = this->radius * this->radius;
+    for(int y = std::max(cy - 1, 0); y <= std::min(cy + 1, this->nCells - 1); y++) {
+        for(int x = std::max(cx - 1, 0); x <= std::min(cx + 1, this->nCells - 1); x++) {
+            int cell = y * this->nCells + x;
+            for(int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+                int v = cellPoints[k];
+                double dx = px[v] - px[u], dy = py[v] - py[u];
+                double d2 = dx * dx + dy * dy;
+                if(v <= u || d2 > r2) {
+                    continue;
+                }
+                int w = (spec.weights == WEIGHT_DISTANCE) ? this->distance_weight(u, v) : this->weight(u, v);
+                out.push_back(u, v, w);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Generate and write the graph on a fresh PSim of nprocs processes (only rank 0
+ *  returns)
+ */
+long long GraphGenerator::write_binary(const char* filename, int nprocs) {
+    PSim comm(nprocs, SWITCH);
+    return this->write_binary(filename, comm);
+}
+
+/*
+ *  Generate the graph on the ranks of 'comm' and write it in the BINARY edge format
+ *  (see edgeStream.h). Each rank generates its block of slots, the per-rank edge
+ *  counts (64-bit: a rank's block may hold more than 2^31 edges) are summed over the
+ *  ranks to give every rank its record offset, rank 0 writes the header
+ *  and sizes the file, and then every rank writes its records at its own offset.
+ *  Returns the total number of edges written (-1 on this rank if its writes failed).
+ */
+long long GraphGenerator::write_binary(const char* filename, PSim& comm) {
+    EdgeArray part;
+    this->generate_partition(comm.rank, comm.nprocs, part);
+    std::vector<long long> mine(comm.nprocs, 0);
+    mine[comm.rank] = static_cast<long long>(part.size());
+    std::vector<long long> counts = sum_counts(comm, mine);
+    long long offset = 0, total = 0;
+    for(int j = 0; j < comm.nprocs; j++) {
+        if(j < comm.rank) {
+            offset += counts[j];
+        }
+        total += counts[j];
+    }
+
+    bool ok = true;
+    const size_t recordBytes = 3 * sizeof(int32_t);
+    if(comm.rank == 0) {
+        char header[EDGE_STREAM_HEADER_BYTES];
+        int32_t version = EDGE_STREAM_VERSION, nv = this->nVerts, reserved = 0;
+        int64_t ne = total;
+        memcpy(header, EDGE_STREAM_MAGIC, 4);
+        memcpy(header + 4, &version, 4);
+        memcpy(header + 8, &nv, 4);
+        memcpy(header + 12, &reserved, 4);
+        memcpy(header + 16, &ne, 8);
+        int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ok = fd >= 0 &&
+             pwrite(fd, header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+             ftruncate(fd, EDGE_STREAM_HEADER_BYTES + total * recordBytes) == 0;
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+    comm.barrier();
+
+    int fd = open(filename, O_WRONLY);
+    ok = ok && fd >= 0;
+    std::vector<int32_t> buf;
+    for(size_t i = 0; ok && i < part.size(); i += EDGE_STREAM_BLOCK) {
+        size_t n = std::min(EDGE_STREAM_BLOCK, part.size() - i);
+        buf.resize(3 * n);
+        for(size_t k = 0; k < n; k++) {
+            buf[3*k] = part.u[i + k];
+            buf[3*k + 1] = part.v[i + k];
+            buf[3*k + 2] = part.w[i + k];
+        }
+        off_t at = EDGE_STREAM_HEADER_BYTES + static_cast<off_t>(offset + i) * recordBytes;
+        ok = pwrite(fd, &buf[0], n * recordBytes, at) == static_cast<ssize_t>(n * recordBytes);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    if(!ok) {
+        std::cerr << "GraphGenerator: rank " << comm.rank << " failed to write " << filename << std::endl;
+    }
+    comm.barrier();
+    return ok ? total : -1;
+}
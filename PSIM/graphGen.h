@@ -0,0 +1,123 @@
+//
+//  graphGen.h
+//  PSIM
+//
+//  Deterministic synthetic graph generators for MST workloads:
+//
+//  ERDOS_RENYI:  G(n, m) -- m distinct vertex pairs chosen uniformly at random
+//  RMAT:         R-MAT / Kronecker graph with m edges and quadrant probabilities a, b, c
+//  GRID2D/3D:    dims[0] x dims[1] (x dims[2]) lattice, edges to the +x/+y/+z neighbours
+//  GEOMETRIC:    n random points in the unit square, edges between points closer than r
+//                (r is chosen so the expected edge count is m)
+//
+//  Every random quantity is a pure function of (seed, stream, counter) through a
+//  counter-based generator, so any range of the output can be produced by any process
+//  in any order and always comes out the same. The output is split into 'slots' (an
+//  edge index for ERDOS_RENYI/RMAT, a source vertex for GRID/GEOMETRIC); a PSim rank
+//  generates its own block of slots.
+//
+
+#ifndef __PSIM__graphGen__
+#define __PSIM__graphGen__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "edgeArray.h"
+
+class PSim;
+
+
+enum GraphKind {
+    ERDOS_RENYI,
+    RMAT,
+    GRID2D,
+    GRID3D,
+    GEOMETRIC
+};
+
+enum WeightDist {
+    WEIGHT_UNIFORM,         //uniform integers in [minWeight, maxWeight]
+    WEIGHT_EXPONENTIAL,     //minWeight + Exp(weightMean), clamped to maxWeight
+    WEIGHT_DISTANCE         //GEOMETRIC only: proportional to edge length (else uniform)
+};
+
+
+struct GraphSpec {
+    GraphKind kind;
+    int nVerts;             //ignored for grids (product of dims)
+    long long nEdges;       //target edge count for ERDOS_RENYI, RMAT and GEOMETRIC
+    int dims[3];
+    double a, b, c;         //RMAT quadrant probabilities (d = 1 - a - b - c)
+    WeightDist weights;
+    int minWeight;          //weights stay within [1, EDGE_KEY_MAX_WEIGHT]
+    int maxWeight;
+    double weightMean;      //WEIGHT_EXPONENTIAL mean; 0 = (maxWeight - minWeight) / 8
+    uint64_t seed;
+    bool connected;         //add a spanning path 0-1-...-(n-1) (not needed for grids)
+
+    GraphSpec();
+
+    bool parse(const std::string& text);
+    std::string str() const;
+};
+
+std::ostream& operator<<(std::ostream& os, const GraphSpec& spec);
+
+
+class GraphGenerator {
+public:
+
+    GraphGenerator(const GraphSpec& spec);
+
+    long long slots() const;
+    void generate(long long begin, long long end, EdgeArray& out) const;
+    void generate_partition(int rank, int nprocs, EdgeArray& out) const;
+    long long write_binary(const char* filename, int nprocs);
+    long long write_binary(const char* filename, PSim& comm);
+
+    GraphSpec spec;
+    int nVerts;
+
+private:
+    void edge_er(long long i, EdgeArray& out) const;
+    void edge_rmat(long long i, EdgeArray& out) const;
+    void edges_grid(int u, EdgeArray& out) const;
+    void edges_geometric(int u, EdgeArray& out) const;
+    int weight(int u, int v) const;
+    int distance_weight(int u, int v) const;
+
+    long long pathSlots;    //leading slots used by the spanning path
+    long long nPairs;       //ERDOS_RENYI: n(n-1)/2
+    int feistelHalf;        //ERDOS_RENYI: half width of the pair permutation in bits
+    uint64_t feistelKeys[4];
+    int scale;              //RMAT: log2 of the padded vertex count
+
+    //GEOMETRIC: point coordinates and a cell grid of side >= radius, points bucketed by
+    //cell in ascending vertex order (cellStart has nCells * nCells + 1 entries)
+    double radius;
+    int nCells;
+    std::vector<double> px, py;
+    std::vector<int> cellStart, cellPoints;
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Counter-based RNG: the counter'th 64-bit draw of stream 'stream' under 'seed'. A
+ *  splitmix64 sequence evaluated at an arbitrary position, so no state is carried.
+ */
+inline uint64_t counter_rng(uint64_t seed, uint64_t stream, uint64_t counter) {
+    uint64_t key = mix64(seed ^ mix64(stream + 0x9e3779b97f4a7c15ULL));
+    return mix64(key + (counter + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+//Uniform double in [0, 1) from the top 53 bits of a draw
+inline double unit_double(uint64_t x) {
+    return static_cast<double>(x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+#endif /* defined(__PSIM__graphGen__) */
@@ -3,30 +3,33 @@
  *  PSIM
  *  Created by Sam Uddin
  *
- *  Driver program. Various tests of the C++ PSim API
+ *  Driver program. Various tests of the C++ PSim API, selected on the command line,
+ *  and the benchmark driver (see benchmark.h).
  */
 
 #include <iostream>
 #include <fstream>
 #include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 #include <string>
+#include <algorithm>
 #include <functional>
+#include <sstream>
 #include "psim.h"
 #include "primsAlgorithm.h"
+#include "streamingMST.h"
+#include "dynamicMST.h"
+#include "benchmark.h"
+#include "graphGen.h"
+#include "psimSocket.h"
+#include "psimWindow.h"
+#include "psimKernels.h"
+#include "threadPool.h"
 
-
-//TEST MACROS (turn on or off for various tests of PSim-cpp's functionality)
-#define BOOST_SERIALIZATION_VECT 0
-#define BOOST_SERIALIZATION_EDGE 0
-#define TOPOLOGY 0
-#define BCAST 0
-#define ALL_BCAST 0
-#define SCATTER 0
-#define COLLECT 0
-#define REDUCE 0
-#define ALL_REDUCE 0
-#define PRIM_SEQUENTIAL 1
-#define PRIM_PARALLEL 0
+//This program, for the commands that launch copies of it (see main)
+static std::string selfPath;
 
 
 static void boost_serialization_test_vector() {
@@ -181,6 +184,13 @@ static void reduce_test() {
     PSim comm(5, SWITCH);
     int red_sum = comm.all2one_reduce(0, comm.rank, sum);
     printf("@process %d (pid %d) => reduction result of sum of ranks is: %d\n", comm.rank, getpid(), red_sum);
+    
+    //values arrive in any order but are folded in rank order: digits 1..5 make 12345
+    std::function<int(int, int)> digits = [](int a, int b) { return 10 * a + b; };
+    int number = comm.all2one_reduce(0, comm.rank + 1, digits);
+    if(comm.rank == 0) {
+        printf("@process %d => rank-order fold: %d\n", comm.rank, number);
+    }
 }
 
 
@@ -194,83 +204,706 @@ static void reduce_all_test() {
     Edge red_sum = comm.all2all_reduce_E(tmp, edgemax);
     printf("@process %d (pid %d) => reduction result of Edge weights is: ", comm.rank, getpid());
     std::cout << red_sum;
+    
+    //Rank 4's edge is outside the packed EdgeKey range (vertex >= 2^20, weight >= 2^23)
+    //and has to arrive intact, not wrapped around into the lightest edge
+    Edge big = (comm.rank == 4) ? Edge(3 << 20, 5, 1 << 24) : Edge(comm.rank, comm.rank + 1, 100 + comm.rank);
+    Edge heaviest = comm.all2all_reduce_E(big, edgemax);
+    Edge lightest = comm.all2all_reduce_E(big, edgemin);
+    Edge bcast = comm.one2all_broadcast_E(4, big);
+    bool ok = heaviest.e[0] == (3 << 20) && heaviest.weight == (1 << 24) && lightest.weight == 100 &&
+              bcast.e[0] == (3 << 20) && bcast.weight == (1 << 24);
+    printf("@process %d => unpackable edge %d %d (%d): %s\n", comm.rank, heaviest.e[0], heaviest.e[1],
+           heaviest.weight, ok ? "ok" : "MISMATCH");
 }
 
 
-/*
- *  Main()
- *
- */
-int main(int argc, const char * argv[]) {
-    
-#if(BOOST_SERIALIZATION_VECT)
-    boost_serialization_test_vector();
-#endif
+static void prim_test(const char* graph, PrimEnum mode, int p) {
+    Prim P(graph, mode, p);
+    P.run();
+}
 
-#if(BOOST_SERIALIZATION_EDGE)
-    boost_serialization_test_edge();
-#endif
-    
-#if(TOPOLOGY)
-    topology_test();
-#endif
-    
-#if(BCAST)
-    bcast_test();
-#endif
 
-#if(ALL_BCAST)
-    all_bcast_test();
-#endif
-    
-#if(SCATTER)
-    scatter_test();
-#endif
-    
-#if(COLLECT)
-    collect_test();
-#endif
-    
-#if(REDUCE)
-    reduce_test();
-#endif
+static void streaming_mst_test(const char* graph) {
+    //1 MB resident budget; works unchanged on TEXT or BINARY edge lists of any length
+    StreamingMST S(graph, 1 << 20);
+    S.run();
+    S.report(std::cout);
+}
 
-#if(ALL_REDUCE)
-    reduce_all_test();
-#endif
-    
-#if(PRIM_SEQUENTIAL)
-    
-    Prim P("/Users/SamUddin/Desktop/graph1.txt", SEQUENTIAL, 0);
-    P.run();
-    
-        
-#endif
-    
-#if(PRIM_PARALLEL)
-    
-    Prim P("/Users/SamUddin/Desktop/graph1.txt", PARALLEL, 2);
+
+static void incremental_mst_test(const char* graph) {
+    Prim P(graph, SEQUENTIAL, 0);
     P.run();
     
+    //Update the MST in place instead of re-running Prim after every change
+    DynamicMST D(P);
+    std::vector<Edge> batch = {Edge(2, 6, 4), Edge(0, 5, 1), Edge(1, 2, 20)};
+    int changed = D.apply(batch);
+    D.decrease_weight(3, 4, 2);
+    std::cout << "-------------------\n";
+    std::cout << changed << " of " << batch.size() << " batched updates changed the MST\n";
+    std::cout << "Updated MST edges (weight), total " << D.totalWeight << ": \n";
+    std::vector<Edge> updated = D.edges();
+    for(std::vector<Edge>::iterator it = updated.begin(); it != updated.end(); it++) {
+        std::cout << *it;
+    }
+}
+
+
+static void placement_test() {
+    //2x2 mesh placed by topology: mesh neighbours share a socket where possible
+    PSim comm(4, MESH2, Placement(PLACE_TOPOLOGY));
+    if(comm.rank == 0) {
+        comm.placement_report(std::cout);
+    }
+    comm.barrier();
+#ifdef __linux__
+    printf("@process %d (pid %d) => running on cpu %d\n", comm.rank, getpid(), sched_getcpu());
 #endif
+}
+
+
+static void pool_test(const char* graph) {
+    //Fork 4 ranks once; every session below reuses them without forking
+    RankPool pool(4);
+    {
+        PSim comm(pool, SWITCH);
+        int msg = comm.one2all_broadcast(0, (comm.rank == 0) ? 112358 : 0);
+        printf("@process %d (pid %d) => pool broadcast: %d\n", comm.rank, getpid(), msg);
+    }
     
+    //Sub-session over the even pool ranks; odd ranks skip it
+    if(pool.rank % 2 == 0) {
+        std::vector<int> evens = {0, 2};
+        PSim comm(pool, evens, SWITCH);
+        int total = comm.all2all_reduce(pool.rank, sum);
+        printf("@process %d (pool rank %d) => sum of even pool ranks: %d\n", comm.rank, pool.rank, total);
+    }
     
+    //Prim twice on the same ranks; every rank returns with the tree
+    for(int i = 0; i < 2; i++) {
+        Prim P(graph, (i == 0) ? PARALLEL : DISTRIBUTED, pool.nprocs, false);
+        P.run(pool);
+        printf("@process %d (pid %d) => MST weight %lld\n", pool.rank, getpid(), P.T.total_weight());
+    }
+}
 
+
+static void generators_test() {
+    //Prim on the in-memory graph (generated by one process, and by 3 ranks in parallel)
+    //vs. StreamingMST on the same graph written in parallel
+    const char* specs[] = {"er,n=300,m=3000", "rmat,n=256,m=2048,weights=exp", "grid2d,dims=20x15",
+                           "grid3d,dims=8x6x5", "geo,n=400,m=4000,weights=distance"};
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/psim_gen_%d.bin", (int)getpid());
+    for(size_t i = 0; i < sizeof(specs) / sizeof(specs[0]); i++) {
+        GraphSpec spec;
+        spec.parse(specs[i]);
+        Prim P(spec, SEQUENTIAL, 0, false);
+        P.run();
+        Prim D(spec, DISTRIBUTED, 3, false);
+        D.run();
+        long long written = GraphGenerator(spec).write_binary(path, 3);
+        StreamingMST S(path, 1 << 16);
+        S.run();
+        bool same = P.T.total_weight() == S.totalWeight && D.T.total_weight() == S.totalWeight && D.nEdges == P.nEdges;
+        std::cout << spec << "\n    " << P.nEdges << " edges (" << written << " written), MST weight "
+                  << P.T.total_weight() << " (Prim) " << D.T.total_weight() << " (distributed) "
+                  << S.totalWeight << " (streaming) " << (same ? "ok" : "MISMATCH") << std::endl;
+    }
+    remove(path);
+}
+
+
+
+static void socket_test(const char* graph) {
+    //Not launched: run this test on 4 launched ranks over TCP loopback, then over a Unix socket
+    SocketOptions opts;
+    if(!SocketOptions::from_env(opts)) {
+        SocketTransport transports[] = {TRANSPORT_TCP, TRANSPORT_UNIX};
+        for(int t = 0; t < 2; t++) {
+            std::string rendezvous = local_rendezvous(transports[t]);
+            std::vector<std::string> args = {selfPath, "test", "socket", graph};
+            int status = launch_ranks(4, rendezvous, args);
+            printf("launch over %s => %s\n", rendezvous.c_str(), (status == 0) ? "ok" : "FAILED");
+        }
+        return;
+    }
     
+    SocketMesh mesh(opts);
+    {
+        PSim comm(mesh, SWITCH);
+        int msg = comm.one2all_broadcast(0, (comm.rank == 0) ? 112358 : 0);
+        int total = comm.all2all_reduce(comm.rank, sum);
+        std::vector<int> all = comm.all2all_broadcast(comm.rank * 10);
+        
+        //4M ints around the ring, more than the socket buffers hold: even ranks send first
+        std::vector<int> big(1 << 22, comm.rank);
+        int next = (comm.rank + 1) % comm.nprocs, prev = (comm.rank + comm.nprocs - 1) % comm.nprocs;
+        std::vector<int> got;
+        if(comm.rank % 2 == 0) {
+            comm._send_vector(next, big);
+            got = comm._recv_vector(prev);
+        }
+        else {
+            got = comm._recv_vector(prev);
+            comm._send_vector(next, big);
+        }
+        bool bulkOk = (got.size() == big.size() && got.front() == prev && got.back() == prev);
+        printf("@rank %d (pid %d, %s) => broadcast %d, sum of ranks %d, all2all[%d] = %d, bulk %s\n",
+               comm.rank, getpid(), mesh.rendezvous.str().c_str(), msg, total, comm.nprocs - 1, all.back(),
+               bulkOk ? "ok" : "MISMATCH");
+    }
     
+    Prim P(graph, DISTRIBUTED, mesh.nprocs, false);
+    P.run(mesh);
+    printf("@rank %d (pid %d) => MST weight %lld\n", mesh.rank, getpid(), P.T.total_weight());
+}
+
+
+
+static void codec_test() {
+    //Round-trip typical payloads through every codec; compare with the text archive
+    std::vector<std::vector<int> > inputs(5);
+    const char* names[] = {"sorted ids", "small counts", "runs", "random", "negative deltas"};
+    srand(7);
+    for(int i = 0; i < 10000; i++) {
+        inputs[0].push_back(1000000 + i * 3 + rand() % 3);
+        inputs[1].push_back(rand() % 12);
+        inputs[2].push_back(i / 500);
+        inputs[3].push_back(rand() - RAND_MAX / 2);
+        inputs[4].push_back(50000 - i * 7);
+    }
+    for(size_t k = 0; k < inputs.size(); k++) {
+        const std::vector<int>& data = inputs[k];
+        std::ostringstream os;
+        {
+            boost::archive::text_oarchive oa(os);
+            oa << data;
+        }
+        printf("%-16s text %7zu bytes |", names[k], os.str().size());
+        for(int c = 0; c < CODEC_NCODECS; c++) {
+            std::string frame;
+            std::vector<int> back;
+            encode_vector(data, static_cast<VectorCodec>(c), frame);
+            bool ok = decode_vector(frame, back) && back == data && frame.size() == encoded_size(static_cast<VectorCodec>(c), &data[0], data.size());
+            printf(" %s %zu%s", CODEC_NAMES[c], frame.size(), ok ? "" : " (MISMATCH)");
+        }
+        printf(" | auto: %s\n", CODEC_NAMES[smallest_codec(&data[0], data.size())]);
+    }
     
+    //Sorted ids scattered over 4 ranks go out delta-encoded
+    PSim comm(4, SWITCH);
+    std::vector<int> ids;
+    if(comm.rank == 0) {
+        ids = inputs[0];
+    }
+    std::vector<int> mine = comm.one2all_scatter(0, ids);
+    printf("@process %d => %zu ids, first %d last %d\n", comm.rank, mine.size(), mine.front(), mine.back());
+}
+
+
+
+static void bulk_test() {
+    //Three 4 MB vectors from rank 0 to each other rank, each freed as soon as it is sent:
+    //the spliced pages must still hold the right values when the receiver reads them
+    {
+        PSim comm(3, SWITCH);
+        const int n = 1 << 20;
+        std::vector<int> got;
+        for(int k = 0; k < 3; k++) {
+            if(comm.rank == 0) {
+                for(int j = 1; j < comm.nprocs; j++) {
+                    std::vector<int> v(n);
+                    for(int i = 0; i < n; i++) {
+                        v[i] = i * (k + 1) + j;
+                    }
+                    comm._send_vector(j, std::move(v));
+                }
+                continue;
+            }
+            comm._recv_vector_into(0, got);
+            bool ok = (int)got.size() == n;
+            for(int i = 0; i < n && ok; i++) {
+                ok = got[i] == i * (k + 1) + comm.rank;
+            }
+            printf("@process %d => bulk vector %d: %s\n", comm.rank, k, ok ? "ok" : "MISMATCH");
+        }
+    }
     
+    //Scatter 4M ints: the root's own 4 MB slice stays local instead of blocking on its pipe
+    PSim comm(4, SWITCH);
+    std::vector<int> data;
+    if(comm.rank == 0) {
+        data.resize(1 << 22);
+        for(size_t i = 0; i < data.size(); i++) {
+            data[i] = (int)i;
+        }
+    }
+    std::vector<int> mine = comm.one2all_scatter(0, data);
+    printf("@process %d => scattered %zu ints, %d..%d\n", comm.rank, mine.size(), mine.front(), mine.back());
+}
+
+
+
+static void recv_any_test() {
+    //Ranks report in reverse rank order; the root takes them as they come
+    PSim comm(4, SWITCH);
+    if(comm.rank != 0) {
+        usleep((comm.nprocs - comm.rank) * 50000);
+        comm.send(0, comm.rank * 100);
+    }
+    else {
+        std::vector<int> waiting = {1, 2, 3};
+        while(!waiting.empty()) {
+            std::pair<int, int> msg = comm.recv_any(waiting);
+            waiting.erase(std::find(waiting.begin(), waiting.end(), msg.first));
+            printf("@process 0 => message from rank %d: %d\n", msg.first, msg.second);
+        }
+    }
     
+    //Rank 1 is late: the others are folded in while the root waits for it
+    if(comm.rank == 1) {
+        usleep(100000);
+    }
+    int total = comm.all2all_reduce(comm.rank + 1, sum);
+    EdgeKey best = comm.all2all_reduce_K(pack_edge(comm.rank, comm.rank + 1, 10 - comm.rank), keymin);
+    std::vector<int> ranks = comm.all2one_collect(0, comm.rank);
+    printf("@process %d => sum %d, min edge weight %d", comm.rank, total, unpack_edge(best).weight);
+    for(size_t i = 0; i < ranks.size(); i++) {
+        printf("%s%d", (i == 0) ? ", collected " : " ", ranks[i]);
+    }
+    printf("\n");
+}
+
+
+static void window_test() {
+    PSim comm(4, SWITCH);
+    const int n = 64;
+    Window win(comm, 2 * n);
+    int* mine = win.local();
+    
+    //A read-mostly table built once by rank 0 and read in place by everyone
+    if(comm.rank == 0) {
+        for(int i = 0; i < n; i++) {
+            mine[n + i] = (i * 37) % n;
+        }
+    }
+    win.fence();
+    const int* table = win.view(0) + n;
+    int tableSum = std::accumulate(table, table + n, 0);
+    
+    //Each rank puts a row into its right neighbour and gets one from its left
+    std::vector<int> row(n);
+    for(int i = 0; i < n; i++) {
+        row[i] = comm.rank * 1000 + i;
+    }
+    int right = (comm.rank + 1) % comm.nprocs;
+    int left = (comm.rank + comm.nprocs - 1) % comm.nprocs;
+    win.put(right, 0, row);
+    win.fence();
+    std::vector<int> got = win.get(left, 0, n);
+    bool rowsOk = true;
+    for(int i = 0; i < n; i++) {
+        rowsOk = rowsOk && mine[i] == left * 1000 + i && got[i] == ((left + comm.nprocs - 1) % comm.nprocs) * 1000 + i;
+    }
+    win.fence();
     
+    //Counters on rank 0 without its help: tickets, an atomic minimum and a locked update
+    if(comm.rank == 0) {
+        mine[0] = 0;
+        mine[1] = 1 << 30;
+        mine[2] = 0;
+    }
+    win.fence();
+    std::vector<int> tickets;
+    for(int k = 0; k < 5; k++) {
+        tickets.push_back(win.fetch_and_op(0, 0, 1, sum));
+    }
+    int candidate = 100 - comm.rank;
+    win.accumulate(0, 1, &candidate, 1, min);
+    for(int k = 0; k < 10; k++) {
+        win.lock(0);
+        int v = win.get(0, 2, 1)[0];
+        v += comm.rank + 1;
+        win.put(0, 2, &v, 1);
+        win.unlock(0);
+    }
+    win.fence();
+    std::vector<int> counters = win.get(0, 0, 3);
+    printf("@process %d => table sum %d, rows %s, tickets %d..%d, count %d, min %d, locked sum %d\n",
+           comm.rank, tableSum, rowsOk ? "ok" : "MISMATCH", tickets.front(), tickets.back(),
+           counters[0], counters[1], counters[2]);
+}
+
+static void sample_sort_test() {
+    //200k random ints per rank: every rank's slice is sorted, the slices follow each
+    //other in rank order, and nothing was lost or duplicated
+    PSim comm(4, SWITCH);
+    const int n = 200000;
+    std::vector<int> data(n);
+    srand(7 + comm.rank);
+    for(int i = 0; i < n; i++) {
+        data[i] = rand() % 1000000;
+    }
+    long long checksum = std::accumulate(data.begin(), data.end(), 0LL);
+    std::vector<int> sorted = sample_sort(comm, data);
+    bool ordered = std::is_sorted(sorted.begin(), sorted.end());
+    std::vector<int> firsts = comm.all2all_broadcast(sorted.empty() ? 1000000 : sorted.front());
+    std::vector<int> lasts = comm.all2all_broadcast(sorted.empty() ? -1 : sorted.back());
+    for(int j = 1; j < comm.nprocs; j++) {
+        ordered = ordered && lasts[j-1] <= firsts[j];
+    }
+    std::vector<long long> totals = sum_counts(comm, {checksum, n, (long long)sorted.size(),
+                                                      std::accumulate(sorted.begin(), sorted.end(), 0LL)});
+    printf("@process %d => %zu keys %d..%d, %s, %s\n", comm.rank, sorted.size(),
+           sorted.empty() ? -1 : sorted.front(), sorted.empty() ? -1 : sorted.back(),
+           ordered ? "ordered" : "NOT ORDERED",
+           (totals[0] == totals[3] && totals[1] == totals[2]) ? "all keys kept" : "KEYS LOST");
+    
+    //Packed edges sort by weight, then endpoints, like any other trivially copyable key
+    std::vector<EdgeKey> keys;
+    for(int i = 0; i < 4; i++) {
+        keys.push_back(pack_edge(comm.rank, i, (comm.rank * 7 + i * 5) % 11));
+    }
+    EdgeKey lightest = comm.all2all_reduce_K(*std::min_element(keys.begin(), keys.end()), keymin);
+    keys = sample_sort(comm, keys);
+    
+    //rank 0 starts with the global minimum and the non-empty slices follow each other
+    std::vector<EdgeKey> ends;
+    if(!keys.empty()) {
+        ends.push_back(keys.front());
+        ends.push_back(keys.back());
+    }
+    std::vector<std::string> frames = gather_frames(comm, 0, pack_frame(ends.data(), ends.size()));
+    int keysOrdered = std::is_sorted(keys.begin(), keys.end());
+    if(comm.rank == 0) {
+        keysOrdered = keysOrdered && !keys.empty() && keys.front() == lightest;
+        std::vector<EdgeKey> all;
+        for(int j = 0; j < comm.nprocs; j++) {
+            unpack_frame(frames[j], all);
+        }
+        keysOrdered = keysOrdered && std::is_sorted(all.begin(), all.end());
+    }
+    keysOrdered = comm.all2all_reduce(keysOrdered, min);
     
+    //Ten bins over [0, 1000000): every rank gets the global counts
+    std::vector<long long> bins = histogram(comm, data, 0, 1000000, 10);
+    long long binned = std::accumulate(bins.begin(), bins.end(), 0LL);
+    printf("@process %d => lightest edge weight %d, edge keys %s, %lld keys binned, first bin %lld\n", comm.rank,
+           keys.empty() ? -1 : unpack_edge(keys.front()).weight, keysOrdered ? "ordered" : "NOT ORDERED", binned, bins[0]);
+}
+
+static void threads_test(const char* graph) {
+    {
+        ThreadPool pool(4);
+        long long total = pool.parallel_reduce<long long>(0, 10000000, 0, [](long long b, long long e) {
+            long long s = 0;
+            for(long long i = b; i < e; i++) {
+                s += i;
+            }
+            return s;
+        }, std::plus<long long>(), 1000);
+        
+        //nested loops and loose tasks land on every thread's deque and get stolen
+        std::atomic<int> cells(0), tasks(0);
+        pool.parallel_for(0, 100, [&](long long r0, long long r1) {
+            for(long long r = r0; r < r1; r++) {
+                pool.parallel_for(0, 100, [&](long long c0, long long c1) { cells += (int)(c1 - c0); });
+            }
+        });
+        for(int i = 0; i < 1000; i++) {
+            pool.submit([&tasks] { tasks++; });
+        }
+        pool.wait();
+        
+        //a task that waits gets back once its own tasks are done, not everyone's
+        std::atomic<int> nested(0), early(0);
+        for(int i = 0; i < 8; i++) {
+            pool.submit([&pool, &nested, &early] {
+                std::atomic<int> mine(0);
+                for(int k = 0; k < 10; k++) {
+                    pool.submit([&nested, &mine] { nested++; mine++; });
+                }
+                pool.wait();
+                if(mine != 10) {
+                    early++;
+                }
+            });
+        }
+        pool.wait();
+        printf("%d threads => sum %lld, %d cells, %d tasks, %d nested (%d early)\n", pool.size(), total,
+               cells.load(), tasks.load(), nested.load(), early.load());
+    }
     
+    //Three threads per rank (matrix construction only for SEQUENTIAL) give the same
+    //tree in every mode
+    GraphSpec spec;
+    spec.parse("er,n=600,m=20000,seed=3");
+    PrimEnum modes[] = {SEQUENTIAL, PARALLEL, DISTRIBUTED};
+    const char* names[] = {"sequential", "parallel", "distributed"};
+    for(int m = 0; m < 3; m++) {
+        Prim P(spec, modes[m], 2, false);
+        P.nThreads = 3;
+        P.run();
+        printf("%s, 3 threads per rank => MST weight %lld\n", names[m], P.T.total_weight());
+    }
+    Prim P(graph, PARALLEL, 2, false);
+    P.nThreads = 3;
+    P.run();
+    printf("%s => MST weight %lld\n", graph, P.T.total_weight());
+}
+
+//------------------------------------------------------------------------------------------------
+
+static void usage() {
+    std::cout <<
+    "usage: PSIM test <name> [graph file]\n"
+    "       PSIM bench <collectives|sessions|kernels|prim|all> [options]\n"
+    "       PSIM trace-merge <prefix> <nprocs> [trace.json]\n"
+    "       PSIM gen <spec> <out.bin> [nprocs]\n"
+    "       PSIM launch <nprocs> [--transport tcp|unix] [--rendezvous ADDR] <command...>\n"
+    "\n"
+    "tests: vector edge topology bcast all_bcast scatter collect reduce all_reduce\n"
+    "       prim_sequential prim_parallel prim_distributed streaming_mst incremental_mst\n"
+    "       generators placement pool socket codec bulk recv_any window sample_sort\n"
+    "       threads\n"
+    "\n"
+    "graph specs: kind[,key=value...], kind = er|rmat|grid2d|grid3d|geo, keys n m dims\n"
+    "             (e.g. 100x100x10) a b c weights (uniform|exp|distance) wmin wmax wmean\n"
+    "             seed connected, e.g. rmat,n=65536,m=1048576,weights=exp\n"
+    "\n"
+    "bench options (lists are comma separated):\n"
+    "  --procs 2,4,8        process counts\n"
+    "  --sizes 1,64,1024    ints per process for one2all_scatter\n"
+    "  --elems 65536        ints per process for the sort/histogram kernels\n"
+    "  --threads 1,2,4      threads per rank for parallel/distributed Prim\n"
+    "  --verts 64,128,256   Prim graph sizes\n"
+    "  --density 0.1,0.5    Prim edge densities\n"
+    "  --reps N             timed repetitions (default 20)\n"
+    "  --warmup N           untimed repetitions (default 2)\n"
+    "  --seed N             graph generator seed\n"
+    "  --placement P        none|compact|scatter|topology|<cpu,cpu,...> (default:\n"
+    "                       PSIM_PLACEMENT)\n"
+    "  --graph SPEC         generator for the Prim graphs (default er; n and m come\n"
+    "                       from --verts and --density)\n"
+    "  --format csv|json    output format (default csv)\n"
+    "  --out FILE           write results to FILE instead of stdout\n"
+    "\n"
+    "launch: runs <nprocs> copies of PSIM <command...> as the ranks of one socket mesh\n"
+    "        (e.g. launch 4 --transport unix bench collectives). Ranks on other machines\n"
+    "        set PSIM_RANK, PSIM_NPROCS and PSIM_RENDEZVOUS=tcp:<host>:<port> themselves.\n"
+    "\n"
+    "codecs: vectors of PSIM_CODEC_THRESHOLD ints (default 64) or more are sent in the\n"
+    "        smallest of raw, delta_varint, for and rle; PSIM_CODEC=off|auto|raw|delta|for|rle\n"
+    "        vectors of PSIM_BULK_THRESHOLD bytes (default 256 KiB) or more skip serialization\n"
+    "\n"
+    "threads: PSIM_THREADS=<n> gives every rank a work-stealing pool of n threads for\n"
+    "         Prim's scans and matrix construction (bench prim --threads sweeps it)\n"
+    "\n"
+    "profiling: run with PSIM_PROFILE=<prefix> (and PSIM_TRACE=1 for a timeline), then\n"
+    "           trace-merge <prefix> <nprocs> to build a Chrome trace and a summary\n";
+}
+
+template<typename T>
+static std::vector<T> parse_list(const std::string& arg) {
+    std::vector<T> out;
+    std::stringstream ss(arg);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        std::stringstream conv(item);
+        T value;
+        if(conv >> value) {
+            out.push_back(value);
+        }
+    }
+    return out;
+}
+
+static int run_test(const std::string& name, const char* graph) {
+    if(name == "vector")                boost_serialization_test_vector();
+    else if(name == "edge")             boost_serialization_test_edge();
+    else if(name == "topology")         topology_test();
+    else if(name == "bcast")            bcast_test();
+    else if(name == "all_bcast")        all_bcast_test();
+    else if(name == "scatter")          scatter_test();
+    else if(name == "collect")          collect_test();
+    else if(name == "reduce")           reduce_test();
+    else if(name == "all_reduce")       reduce_all_test();
+    else if(name == "prim_sequential")  prim_test(graph, SEQUENTIAL, 0);
+    else if(name == "prim_parallel")    prim_test(graph, PARALLEL, 2);
+    else if(name == "prim_distributed") prim_test(graph, DISTRIBUTED, 3);
+    else if(name == "streaming_mst")    streaming_mst_test(graph);
+    else if(name == "incremental_mst")  incremental_mst_test(graph);
+    else if(name == "generators")       generators_test();
+    else if(name == "placement")        placement_test();
+    else if(name == "pool")             pool_test(graph);
+    else if(name == "socket")           socket_test(graph);
+    else if(name == "codec")            codec_test();
+    else if(name == "bulk")             bulk_test();
+    else if(name == "recv_any")         recv_any_test();
+    else if(name == "window")           window_test();
+    else if(name == "sample_sort")      sample_sort_test();
+    else if(name == "threads")          threads_test(graph);
+    else {
+        usage();
+        return 1;
+    }
+    return 0;
+}
+
+static int run_bench(const std::string& which, int argc, const char * argv[]) {
+    BenchOptions opts;
+    std::string outFile;
+    for(int i = 0; i + 1 < argc; i += 2) {
+        std::string flag = argv[i], value = argv[i+1];
+        if(flag == "--procs")        opts.procs = parse_list<int>(value);
+        else if(flag == "--sizes")   opts.sizes = parse_list<int>(value);
+        else if(flag == "--elems")   opts.elems = parse_list<int>(value);
+        else if(flag == "--threads") opts.threads = parse_list<int>(value);
+        else if(flag == "--verts")   opts.verts = parse_list<int>(value);
+        else if(flag == "--density") opts.densities = parse_list<double>(value);
+        else if(flag == "--reps")    opts.reps = atoi(value.c_str());
+        else if(flag == "--warmup")  opts.warmup = atoi(value.c_str());
+        else if(flag == "--seed")    opts.seed = (unsigned)atoi(value.c_str());
+        else if(flag == "--graph")   opts.graph = value;
+        else if(flag == "--placement") opts.placement = value;
+        else if(flag == "--format")  opts.format = value;
+        else if(flag == "--out")     outFile = value;
+        else {
+            usage();
+            return 1;
+        }
+    }
     
+    //every PSim the benchmark creates, including the ones inside Prim, reads the policy
+    //from the environment
+    if(!opts.placement.empty()) {
+        setenv("PSIM_PLACEMENT", opts.placement.c_str(), 1);
+    }
     
+    //launched as a socket rank: time the collectives over the mesh, rank 0 reports
+    SocketOptions socketOpts;
+    if(SocketOptions::from_env(socketOpts)) {
+        std::vector<BenchResult> results;
+        {
+            SocketMesh mesh(socketOpts);
+            if(which == "collectives" || which == "all") {
+                bench_collectives(opts, results, &mesh);
+            }
+            if(which == "kernels" || which == "all") {
+                bench_kernels(opts, results, &mesh);
+            }
+        }
+        if(socketOpts.rank != 0) {
+            return 0;
+        }
+        if(outFile.empty()) {
+            write_results(std::cout, results, opts.format);
+        }
+        else {
+            std::ofstream out(outFile.c_str());
+            write_results(out, results, opts.format);
+        }
+        return 0;
+    }
     
+    std::vector<BenchResult> results;
+    if(which == "collectives" || which == "all") {
+        bench_collectives(opts, results);
+    }
+    if(which == "sessions" || which == "all") {
+        bench_sessions(opts, results);
+    }
+    if(which == "kernels" || which == "all") {
+        bench_kernels(opts, results);
+    }
+    if(which == "prim" || which == "all") {
+        bench_prim(opts, results);
+    }
+    if(results.empty()) {
+        usage();
+        return 1;
+    }
     
-    
+    if(outFile.empty()) {
+        write_results(std::cout, results, opts.format);
+    }
+    else {
+        std::ofstream out(outFile.c_str());
+        write_results(out, results, opts.format);
+    }
     return 0;
-    
 }
 
+/*
+ *  Run p copies of this program with the remaining arguments as one socket mesh on
+ *  this machine
+ */
+static int run_launch(int p, int argc, const char * argv[]) {
+    SocketTransport transport = TRANSPORT_TCP;
+    std::string rendezvous;
+    int i = 0;
+    for(; i + 1 < argc && std::string(argv[i]).compare(0, 2, "--") == 0; i += 2) {
+        std::string flag = argv[i], value = argv[i+1];
+        if(flag == "--transport" && (value == "tcp" || value == "unix")) {
+            transport = (value == "unix") ? TRANSPORT_UNIX : TRANSPORT_TCP;
+        }
+        else if(flag == "--rendezvous") rendezvous = value;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if(p < 1 || i >= argc) {
+        usage();
+        return 1;
+    }
+    if(rendezvous.empty()) {
+        rendezvous = local_rendezvous(transport);
+    }
+    std::vector<std::string> args(1, selfPath);
+    args.insert(args.end(), argv + i, argv + argc);
+    return launch_ranks(p, rendezvous, args);
+}
 
+/*
+ *  Main()
+ *
+ */
+int main(int argc, const char * argv[]) {
+    
+#ifdef __linux__
+    selfPath = "/proc/self/exe";
+#else
+    selfPath = argv[0];
+#endif
+    if(argc >= 3 && std::string(argv[1]) == "test") {
+        return run_test(argv[2], (argc >= 4) ? argv[3] : "graph1.txt");
+    }
+    if(argc >= 3 && std::string(argv[1]) == "bench") {
+        return run_bench(argv[2], argc - 3, argv + 3);
+    }
+    if(argc >= 4 && std::string(argv[1]) == "gen") {
+        GraphSpec spec;
+        if(!spec.parse(argv[2])) {
+            usage();
+            return 1;
+        }
+        long long written = GraphGenerator(spec).write_binary(argv[3], (argc >= 5) ? atoi(argv[4]) : 1);
+        std::cout << spec << ": " << written << " edges written to " << argv[3] << std::endl;
+        return (written < 0) ? 1 : 0;
+    }
+    if(argc >= 4 && std::string(argv[1]) == "launch") {
+        return run_launch(atoi(argv[2]), argc - 3, argv + 3);
+    }
+    if(argc >= 4 && std::string(argv[1]) == "trace-merge") {
+        std::string prefix = argv[2];
+        std::string traceFile = (argc >= 5) ? argv[4] : prefix + ".trace.json";
+        return Profiler::merge(prefix, atoi(argv[3]), traceFile, std::cout) == 0 ? 0 : 1;
+    }
+    usage();
+    return 0;
+    
+}
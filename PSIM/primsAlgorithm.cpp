@@ -9,191 +9,576 @@
 #include <climits>
 #include "primsAlgorithm.h"
 #include "psim.h"
+#include "psimKernels.h"
+#include "threadPool.h"
+
+/*
+ *  Candidate edges are compared as packed EdgeKeys (see edgeArray.h). An edge outside
+ *  the packed ranges would wrap around into a different (often the lightest) key and
+ *  silently produce a wrong tree, so such a graph is refused.
+ */
+static bool check_packable(int u, int v, int weight) {
+    if(packable(u, v, weight)) {
+        return true;
+    }
+    std::cerr << "Prim: edge " << u << " " << v << " (" << weight << ") exceeds the packed edge range; "
+              << "vertices must be < " << EDGE_KEY_MAX_VERTS << " and weights in ["
+              << EDGE_KEY_MIN_WEIGHT << ", " << EDGE_KEY_MAX_WEIGHT << "]\n";
+    return false;
+}
+
+//An edge Prim can use: both endpoints are vertices of the graph and it packs
+static bool check_edge(int nVerts, int u, int v, int weight) {
+    if(u < 0 || u >= nVerts || v < 0 || v >= nVerts) {
+        std::cerr << "Prim: edge " << u << " " << v << " (" << weight << ") has a vertex outside [0, "
+                  << nVerts << ")\n";
+        return false;
+    }
+    return check_packable(u, v, weight);
+}
+
+//Slots a rank generates per round of DISTRIBUTED loading
+static const long long LOAD_CHUNK = 1 << 16;
 
 /*
  *  Constructor taking in the filename of a text file of an
  *  undirected weighted graph and an enum for sequential or parallel.
- *  If parallel, input # of processors for PSim.
+ *  If parallel, input # of processors for PSim. With verbose = false
+ *  nothing is printed (used by the benchmark driver).
  */
-Prim::Prim(const char* filename, PrimEnum typeIn, int nProcs) {
-    this->type = typeIn;
-    this->nPsimProcs = nProcs;
+Prim::Prim(const char* filename, PrimEnum typeIn, int nProcs, bool verbose) {
+    this->init(typeIn, nProcs, verbose);
+    this->filename = filename;
     
-    //open and read file of weighted undirected graph
+    //read the header of the weighted undirected graph
     std::ifstream infs(filename);
-    std::cout << "Prim's Algorithm -- " << "Undirected Weighted Graph\n";
-    std::cout << ((this->type == PrimEnum::SEQUENTIAL) ? "SEQUENTIAL\n" : "PARALLEL\n");
-    std::cout << filename << std::endl;
     infs >> this->nVerts;
     infs >> this->nEdges;
-    std::cout << "Vertices: " << this->nVerts << "\nEdges: " << this->nEdges << std::endl;
-    
-    //Dynamically allocate adjMatrix to serve as a nVerts x nVerts adjacency matrix for
-    //the weighted undirected graph
-    this->adjMatrix = new int*[this->nVerts];
-    for(int i = 0; i < this->nVerts; i++) {
-        adjMatrix[i] = new int[this->nVerts];
+    infs.close();
+    if(this->verbose) {
+        std::cout << "Prim's Algorithm -- " << "Undirected Weighted Graph\n";
+        std::cout << ((this->type == PrimEnum::SEQUENTIAL) ? "SEQUENTIAL\n" :
+                      (this->type == PrimEnum::PARALLEL) ? "PARALLEL\n" : "DISTRIBUTED\n");
+        std::cout << filename << std::endl;
+        std::cout << "Vertices: " << this->nVerts << "\nEdges: " << this->nEdges << std::endl;
     }
     
-    //Zero out the adjaceny matrix
-    for(int i = 0; i < this->nVerts; i++) {
-        for(int j = 0; j < this->nVerts; j++) {
-            adjMatrix[i][j] = 0;
+    //In DISTRIBUTED mode nothing beyond the header is loaded here: after PSim has
+    //forked, rank 0 reads the edges and sends each rank its own block of rows (see
+    //load_slice)
+    if(this->type != PrimEnum::DISTRIBUTED) {
+        this->load_matrix();
+    }
+}
+
+/*
+ *  Constructor taking a generated graph (see graphGen.h) instead of a file. The edges
+ *  are produced in memory; in DISTRIBUTED mode the ranks generate them in parallel
+ *  after the fork, each its own block of slots (see load_slice).
+ */
+Prim::Prim(const GraphSpec& spec, PrimEnum typeIn, int nProcs, bool verbose) {
+    this->init(typeIn, nProcs, verbose);
+    this->generator = new GraphGenerator(spec);
+    this->nVerts = this->generator->nVerts;
+    this->nEdges = 0;   //counted while loading
+    if(this->verbose) {
+        std::cout << "Prim's Algorithm -- " << "Undirected Weighted Graph\n";
+        std::cout << ((this->type == PrimEnum::SEQUENTIAL) ? "SEQUENTIAL\n" :
+                      (this->type == PrimEnum::PARALLEL) ? "PARALLEL\n" : "DISTRIBUTED\n");
+        std::cout << "generated: " << this->generator->spec << std::endl;
+        std::cout << "Vertices: " << this->nVerts << std::endl;
+    }
+    if(this->type != PrimEnum::DISTRIBUTED) {
+        this->load_matrix();
+    }
+}
+
+void Prim::init(PrimEnum typeIn, int nProcs, bool verboseIn) {
+    this->type = typeIn;
+    this->nPsimProcs = nProcs;
+    this->nThreads = ThreadPool::threads_from_env();
+    this->verbose = verboseIn;
+    this->rank = 0;
+    this->nVerts = 0;
+    this->nEdges = 0;
+    this->adjMatrix = nullptr;
+    this->localRows = nullptr;
+    this->vBegin = 0;
+    this->vEnd = 0;
+    this->generator = nullptr;
+}
+
+
+/*
+ *  Destructor -- clean up and deallocate adjacency matrix
+ *
+ */
+Prim::~Prim() {
+    if(this->adjMatrix != nullptr) {
+        for(int i = 0; i < this->nVerts; i++){
+            delete [] this->adjMatrix[i];
+        }
+        delete [] this->adjMatrix;
+    }
+    delete [] this->localRows;
+    delete this->generator;
+}
+
+/*
+ *  Call visit(u, v, weight) for every edge of the input graph, read from the file or
+ *  produced by the generator in blocks of slots. Returns after the last edge; the
+ *  number of edges seen is stored in nEdges. With a 'pool', the generator's blocks
+ *  are produced a batch at a time by its threads and still visited in slot order.
+ */
+void Prim::for_each_edge(const std::function<void(int, int, int)>& visit, ThreadPool* pool) {
+    if(this->generator != nullptr) {
+        const long long block = 1 << 16;
+        long long total = this->generator->slots(), count = 0;
+        int batch = (pool != nullptr) ? 2 * pool->size() : 1;
+        std::vector<EdgeArray> edges(batch);
+        for(long long s = 0; s < total; s += block * batch) {
+            auto generate = [this, &edges, s, block, total](long long b0, long long b1) {
+                for(long long b = b0; b < b1; b++) {
+                    edges[b].clear();
+                    if(s + b * block < total) {
+                        this->generator->generate(s + b * block, std::min(s + (b + 1) * block, total), edges[b]);
+                    }
+                }
+            };
+            if(pool != nullptr) {
+                pool->parallel_for(0, batch, generate);
+            }
+            else {
+                generate(0, batch);
+            }
+            for(int b = 0; b < batch; b++) {
+                for(size_t i = 0; i < edges[b].size(); i++) {
+                    if(!check_edge(this->nVerts, edges[b].u[i], edges[b].v[i], edges[b].w[i])) {
+                        exit(1);
+                    }
+                    visit(edges[b].u[i], edges[b].v[i], edges[b].w[i]);
+                }
+                count += edges[b].size();
+            }
         }
+        this->nEdges = count;
+        return;
     }
     
-    //Load edges and weights from file
+    std::ifstream infs(this->filename.c_str());
+    int nv, ne;
+    infs >> nv;
+    infs >> ne;
+    
     int u, v, weight;
-    for (int i = 0; i < this->nEdges; i++) {
+    for (long long i = 0; i < this->nEdges; i++) {
         infs >> u;
         infs >> v;
         infs >> weight;
-        adjMatrix[u][v] = weight;
-        adjMatrix[v][u] = weight;
+        if(!check_edge(this->nVerts, u, v, weight)) {
+            exit(1);
+        }
+        visit(u, v, weight);
     }
     infs.close();
+}
+
+/*
+ *  Build the full nVerts x nVerts adjacency matrix (SEQUENTIAL/PARALLEL). This runs
+ *  before PSim forks, so its thread pool is gone again by the time run() is called.
+ */
+void Prim::load_matrix() {
+    ThreadPool pool(this->nThreads);
+    
+    //Dynamically allocate adjMatrix to serve as a nVerts x nVerts adjacency matrix for
+    //the weighted undirected graph, zeroed, one block of rows per thread
+    this->adjMatrix = new int*[this->nVerts];
+    pool.parallel_for(0, this->nVerts, [this](long long i0, long long i1) {
+        for(long long i = i0; i < i1; i++) {
+            this->adjMatrix[i] = new int[this->nVerts]();
+        }
+    });
+    
+    //Load edges and weights
+    this->for_each_edge([this](int u, int v, int weight) {
+        this->adjMatrix[u][v] = weight;
+        this->adjMatrix[v][u] = weight;
+    }, &pool);
+    if(this->verbose && this->generator != nullptr) {
+        std::cout << "Edges: " << this->nEdges << std::endl;
+    }
     
     //Print a representation of the adjacency matrix
-    for(int i = 0; i < this->nVerts; i++) {
-        for(int j = 0; j < this->nVerts; j++) {
-            std::cout << adjMatrix[i][j] << " ";
+    if(this->verbose && (this->generator == nullptr || this->nVerts <= 64)) {
+        for(int i = 0; i < this->nVerts; i++) {
+            for(int j = 0; j < this->nVerts; j++) {
+                std::cout << adjMatrix[i][j] << " ";
+            }
+            std::cout << std::endl;
         }
-        std::cout << std::endl;
     }
 }
 
+/*
+ *  Block partition of the vertex set among nprocs processes. Rank 'rank' owns
+ *  vertices [begin, end). Shared by the PARALLEL and DISTRIBUTED modes.
+ */
+static void vertex_block(int nVerts, int nprocs, int rank, int& begin, int& end) {
+    int delta = (nVerts/nprocs) + ((nVerts % nprocs) ? 1 : 0);
+    begin = (nVerts > (delta * rank)) ? (delta * rank) : nVerts;
+    end = (nVerts > (delta * (rank+1))) ? (delta * (rank+1)) : nVerts;
+}
+
+//Rank owning vertex x under vertex_block
+static int vertex_owner(int nVerts, int nprocs, int x) {
+    int delta = (nVerts/nprocs) + ((nVerts % nprocs) ? 1 : 0);
+    return x / delta;
+}
 
 /*
- *  Destructor -- clean up and deallocate adjacency matrix
- *
+ *  Load this rank's block of rows [vBegin, vEnd) from the graph, so per-rank memory
+ *  is O(nVerts^2 / p) instead of O(nVerts^2). The edges are produced a chunk at a time
+ *  and every edge is sent to the owners of its two endpoints (see deliver). A file is
+ *  read once, by rank 0, so the other ranks never touch it; a generated graph is
+ *  produced by all ranks in parallel, each generating its own block of slots.
  */
-Prim::~Prim() {
-    for(int i = 0; i < this->nVerts; i++){
-        delete this->adjMatrix[i];
+void Prim::load_slice(PSim& comm, ThreadPool& pool) {
+    int p = comm.nprocs;
+    vertex_block(this->nVerts, p, comm.rank, this->vBegin, this->vEnd);
+    
+    size_t nLocal = static_cast<size_t>(this->vEnd - this->vBegin);
+    delete [] this->localRows;
+    this->localRows = new int[nLocal * this->nVerts];
+    pool.parallel_for(0, nLocal, [this](long long r0, long long r1) {
+        std::fill(this->localRows + r0 * this->nVerts, this->localRows + r1 * this->nVerts, 0);
+    });
+    
+    //every rank takes part in as many rounds as the largest block needs
+    long long total = 0, sBegin = 0, sEnd = 0, rounds = 0;
+    std::ifstream infs;
+    if(this->generator != nullptr) {
+        total = this->generator->slots();
+        sBegin = total * comm.rank / p;
+        sEnd = total * (comm.rank + 1) / p;
+        rounds = ((total + p - 1) / p + LOAD_CHUNK - 1) / LOAD_CHUNK;
+    }
+    else {
+        rounds = (this->nEdges + LOAD_CHUNK - 1) / LOAD_CHUNK;
+        if(comm.rank == 0) {
+            int nv, ne;
+            infs.open(this->filename.c_str());
+            infs >> nv;
+            infs >> ne;
+        }
+    }
+    int pieces = pool.size();
+    std::vector<EdgeArray> edges(pieces);
+    std::vector<std::vector<int> > outgoing(p);
+    long long count = 0;
+    int bad = 0;
+    for(long long r = 0; r < rounds; r++) {
+        if(this->generator != nullptr) {
+            long long c0 = std::min(sBegin + r * LOAD_CHUNK, sEnd), c1 = std::min(c0 + LOAD_CHUNK, sEnd);
+            pool.parallel_for(0, pieces, [this, &edges, c0, c1, pieces](long long b0, long long b1) {
+                for(long long b = b0; b < b1; b++) {
+                    edges[b].clear();
+                    this->generator->generate(c0 + (c1 - c0) * b / pieces, c0 + (c1 - c0) * (b + 1) / pieces, edges[b]);
+                }
+            });
+        }
+        else if(comm.rank == 0) {
+            edges[0].clear();
+            long long n = std::min(LOAD_CHUNK, this->nEdges - r * LOAD_CHUNK);
+            int u, v, weight;
+            for(long long i = 0; i < n; i++) {
+                infs >> u;
+                infs >> v;
+                infs >> weight;
+                edges[0].push_back(u, v, weight);
+            }
+        }
+        for(int b = 0; b < pieces; b++) {
+            for(size_t i = 0; i < edges[b].size() && !bad; i++) {
+                int u = edges[b].u[i], v = edges[b].v[i], w = edges[b].w[i];
+                //a bad edge is not routed, so every rank still reaches the reduction below
+                if(!check_edge(this->nVerts, u, v, w)) {
+                    bad = 1;
+                    break;
+                }
+                std::vector<int>& toU = outgoing[vertex_owner(this->nVerts, p, u)];
+                toU.push_back(u);
+                toU.push_back(v);
+                toU.push_back(w);
+                std::vector<int>& toV = outgoing[vertex_owner(this->nVerts, p, v)];
+                toV.push_back(v);
+                toV.push_back(u);
+                toV.push_back(w);
+            }
+            count += edges[b].size();
+        }
+        this->deliver(comm, outgoing);
+    }
+    
+    //a graph one rank refused is refused by all of them
+    if(comm.all2all_reduce(bad, max) != 0) {
+        exit(1);
+    }
+    if(this->generator != nullptr) {
+        std::vector<long long> counts(1, count);
+        this->nEdges = sum_counts(comm, counts)[0];
+    }
+}
+
+/*
+ *  Collective. outgoing[j] holds (row, column, weight) triples for rows owned by rank
+ *  j; each rank is sent its triples with a personalized all-to-all and stores the ones
+ *  it receives in localRows. 'outgoing' is left empty.
+ */
+void Prim::deliver(PSim& comm, std::vector<std::vector<int> >& outgoing) {
+    std::vector<std::string> parts(comm.nprocs);
+    for(int j = 0; j < comm.nprocs; j++) {
+        parts[j] = pack_frame(outgoing[j].data(), outgoing[j].size());
+        outgoing[j].clear();
+    }
+    std::vector<std::string> incoming = comm.all2all_personalized(std::move(parts));
+    std::vector<int> cells;
+    for(int j = 0; j < comm.nprocs; j++) {
+        cells.clear();
+        unpack_frame(incoming[j], cells);
+        std::string().swap(incoming[j]);
+        for(size_t i = 0; i + 2 < cells.size(); i += 3) {
+            this->localRows[static_cast<size_t>(cells[i] - this->vBegin) * this->nVerts + cells[i + 1]] = cells[i + 2];
+        }
     }
-    delete [] this->adjMatrix;
 }
 
 /*
  *  Run Prim's Algorithm and output the Edges comprising the MST.
  *  Will call the version of algorithm specified on instantiation.
+ *  PARALLEL and DISTRIBUTED fork a fresh PSim of nPsimProcs processes; only
+ *  rank 0 returns.
  *
  */
 void Prim::run() {
     if(this->type == PrimEnum::SEQUENTIAL) {
         this->run_sequential();
+        return;
+    }
+    PSim comm(this->nPsimProcs, SWITCH);
+    this->run_session(comm);
+}
+
+/*
+ *  Run on the ranks of an existing RankPool or SocketMesh without forking. Every rank
+ *  must call this (with its own copy of the Prim) and every rank returns with the MST.
+ */
+void Prim::run(RankGroup& group) {
+    if(this->type == PrimEnum::SEQUENTIAL) {
+        this->run_sequential();
+        return;
+    }
+    PSim comm(group, SWITCH);
+    this->run_session(comm);
+}
+
+/*
+ *  Each rank scans with nThreads threads. The pool is created here, after PSim has
+ *  forked the rank, and only this thread talks to the other ranks.
+ */
+void Prim::run_session(PSim& comm) {
+    ThreadPool pool(this->nThreads);
+    if(this->type == PrimEnum::PARALLEL) {
+        this->run_parallel(comm, pool);
+    }
+    else if(this->type == PrimEnum::DISTRIBUTED) {
+        this->run_distributed(comm, pool);
+    }
+}
+
+//Columns per scan block: enough that each block visits at least ~32k matrix cells
+static long long scan_grain(size_t treeSize) {
+    return std::max(1LL, 32768LL / static_cast<long long>(std::max<size_t>(treeSize, 1)));
+}
+
+/*
+ *  Reset the tree to the single start vertex 0
+ */
+void Prim::begin_tree() {
+    X.assign(1, 0);
+    inX.assign(this->nVerts, 0);
+    parent.assign(this->nVerts, -1);
+    T.clear();
+    T.reserve(this->nVerts > 0 ? this->nVerts - 1 : 0);
+    if(this->nVerts > 0) {
+        inX[0] = 1;
     }
-    else if(this->type == PrimEnum::PARALLEL) {
-        this->run_parallel();
+}
+
+/*
+ *  Add the winning crossing edge (x in X, k not in X) to the tree. Returns false if
+ *  there was no crossing edge, i.e. the remaining vertices are unreachable.
+ */
+bool Prim::grow_tree(EdgeKey best) {
+    if(best == EDGE_KEY_NONE) {
+        std::cerr << "Prim: graph is disconnected, " << (this->nVerts - (int)X.size()) << " vertices unreachable\n";
+        return false;
     }
+    int x = key_u(best), k = key_v(best);
+    T.push_back(x, k, key_weight(best));   //Insert the Edge into the MST
+    parent[k] = x;
+    X.push_back(k);                         //Add the new vertex to set X
+    inX[k] = 1;
+    return true;
+}
+
+void Prim::print_tree() const {
+    if(!this->verbose) {
+        return;
+    }
+    std::cout << "-------------------\n";
+    std::cout << "MST edges (weight): \n";
+    std::cout << T;
 }
 
 void Prim::run_sequential() {
     
-    std::set<int> X;
-    //We need an unordered_set<Edge, HashEdge> here with a custom hash function and operator== :
-    std::unordered_set<Edge, HashEdge> T;
-    
-    //start at an arbitrary vertex --> 0
-    X.insert(0);
+    //X, T and parent are members so the MST stays available after run() (see DynamicMST)
+    this->begin_tree();
     
-    while (X.size() != this->nVerts) {
-        Edge edgy;
-        int d = 0;
+    while (X.size() != static_cast<size_t>(this->nVerts)) {
+        EdgeKey best = EDGE_KEY_NONE;
         
-        for(std::set<int>::iterator it = X.begin(); it != X.end(); it++) {
-            int x = *it;
+        for(size_t i = 0; i < X.size(); i++) {
+            int x = X[i];
+            const int *row = this->adjMatrix[x];
             
             for(int k = 0; k < this->nVerts; k++) {
                 
-                //if k is NOT in set X
-                if(X.find(k) == X.end()) {
-                    int link = this->adjMatrix[x][k];
-                    if(link != 0) {
-                        if(d == 0 || link < d) {
-                            edgy.set(x, k, this->adjMatrix[x][k]);
-                            d = link;
-                        }
+                //if k is NOT in set X and k is connected to x
+                if(!inX[k] && row[k] != 0) {
+                    EdgeKey cand = pack_edge(x, k, row[k]);
+                    if(cand < best) {
+                        best = cand;
                     }
                 }
             }
         }
-        T.insert(edgy);        //Insert Edge edgy into the MST
-        X.insert(edgy.e[1]);   //Add the new vertex to set X
+        if(!this->grow_tree(best)) {
+            break;
+        }
     }
     
     //Print the Edges of the MST
-    std::cout << "-------------------\n";
-    std::cout << "MST edges (weight): \n";
-    for(std::unordered_set<Edge, HashEdge>::iterator treeIt = T.begin(); treeIt != T.end(); treeIt++) {
-        Edge ed = *treeIt;
-        std::cout << ed;
-    }
+    this->print_tree();
 }
 
-void Prim::run_parallel() {
-    
-    std::set<int> X;
-    std::unordered_set<Edge, HashEdge> T;
-    
-    //start at an arbitrary vertex --> 0 for all p
-    X.insert(0);
+void Prim::run_parallel(PSim& comm, ThreadPool& pool) {
     
-    std::cout << "-------------------\n";
-    std::cout << this->nPsimProcs << " processes running.\n";
+    this->begin_tree();
+    this->rank = comm.rank;
     
-    //Init PSim
-    PSim comm(this->nPsimProcs, SWITCH);
+    if(this->verbose && comm.rank == 0) {
+        std::cout << "-------------------\n";
+        std::cout << comm.nprocs << " processes running.\n";
+    }
     
     //Partition the set of vertices among the p processes
-    int delta = (this->nVerts/comm.nprocs) + ((this->nVerts % comm.nprocs) ? 1 : 0);
-    int vBegin = delta * comm.rank;
-    int vEnd = (this->nVerts > (delta * (comm.rank+1))) ? (delta * (comm.rank+1)) : this->nVerts;
-    std::cout << "rank " << comm.rank << " pid:" << (int)getpid() << " >> vBegin: " << vBegin << " vEnd: " << vEnd << std::endl;
-    
-    while (X.size() != this->nVerts) {
-        Edge edgy;
-        int d = INT_MAX;
-        
-        for(std::set<int>::iterator it = X.begin(); it != X.end(); it++) {
-            int x = *it;
-            
-            //Each process p iterates through its local set of vertices in parallel
-            for (int k = vBegin; k < vEnd; k++) {
+    int vBegin, vEnd;
+    vertex_block(this->nVerts, comm.nprocs, comm.rank, vBegin, vEnd);
+    if(this->verbose) {
+        std::cout << "rank " << comm.rank << " pid:" << (int)getpid() << " >> vBegin: " << vBegin << " vEnd: " << vEnd << std::endl;
+    }
+    
+    while (X.size() != static_cast<size_t>(this->nVerts)) {
+        //EDGE_KEY_NONE if this process has no crossing edge; it loses every keymin.
+        //Each process p iterates through its local set of vertices in parallel, and
+        //its threads split that set again
+        EdgeKey best = pool.parallel_reduce<EdgeKey>(vBegin, vEnd, EDGE_KEY_NONE, [this](long long k0, long long k1) {
+            EdgeKey best = EDGE_KEY_NONE;
+            for(size_t i = 0; i < X.size(); i++) {
+                int x = X[i];
+                const int *row = this->adjMatrix[x];
                 
-                //if k is NOT in set X
-                if(X.find(k) == X.end()) {
-                    int link = this->adjMatrix[x][k];
-                    //If k is connected to x
-                    if(link != 0) {
-                        if(link < d) {
-                            edgy.set(x, k, this->adjMatrix[x][k]);
-                            d = link;
+                for (int k = (int)k0; k < k1; k++) {
+                    
+                    //if k is NOT in set X and k is connected to x
+                    if(!inX[k] && row[k] != 0) {
+                        EdgeKey cand = pack_edge(x, k, row[k]);
+                        if(cand < best) {
+                            best = cand;
                         }
-                        
                     }
-                    
                 }
             }
-            
+            return best;
+        }, keymin, scan_grain(X.size()));
+        
+        best = comm.all2all_reduce_K(best, keymin);
+        if(!this->grow_tree(best)) {
+            break;
         }
-      
-        edgy = comm.all2all_reduce_E(edgy, edgemin);
-        T.insert(edgy);        //Insert Edge edgy into the MST
-        X.insert(edgy.e[1]);   //Add the new vertex to set X
     }
     
+    //Print the Edges of the MST
+    this->print_tree();
+}
+
+/*
+ *  Same algorithm as run_parallel, but no rank ever holds the full adjacency matrix.
+ *  Each rank loads only the rows of the vertices it owns after the fork and scans
+ *  them to propose its lightest crossing edge for the global reduction.
+ */
+void Prim::run_distributed(PSim& comm, ThreadPool& pool) {
+    
+    this->begin_tree();
+    this->rank = comm.rank;
     
-        //Print the Edges of the MST
+    if(this->verbose && comm.rank == 0) {
         std::cout << "-------------------\n";
-        std::cout << "MST edges (weight): \n";
-        for(std::unordered_set<Edge, HashEdge>::iterator treeIt = T.begin(); treeIt != T.end(); treeIt++) {
-            Edge ed = *treeIt;
-            std::cout << ed;
-        }
+        std::cout << comm.nprocs << " processes running.\n";
+    }
     
+    //Load this rank's slice of the graph
+    this->load_slice(comm, pool);
+    if(this->verbose) {
+        std::cout << "rank " << comm.rank << " pid:" << (int)getpid() << " >> vBegin: " << this->vBegin << " vEnd: " << this->vEnd
+                  << " (" << (static_cast<size_t>(this->vEnd - this->vBegin) * this->nVerts * sizeof(int)) << " bytes)" << std::endl;
+    }
     
+    while (X.size() != static_cast<size_t>(this->nVerts)) {
+        
+        //Each process scans its own rows, a block of them per thread: row k holds the
+        //weights from k to every x
+        EdgeKey best = pool.parallel_reduce<EdgeKey>(this->vBegin, this->vEnd, EDGE_KEY_NONE, [this](long long k0, long long k1) {
+            EdgeKey best = EDGE_KEY_NONE;
+            for (int k = (int)k0; k < k1; k++) {
+                
+                //if k is NOT in set X
+                if(!inX[k]) {
+                    const int *row = this->localRows + static_cast<size_t>(k - this->vBegin) * this->nVerts;
+                    
+                    for(size_t i = 0; i < X.size(); i++) {
+                        int x = X[i];
+                        if(row[x] != 0) {
+                            EdgeKey cand = pack_edge(x, k, row[x]);
+                            if(cand < best) {
+                                best = cand;
+                            }
+                        }
+                    }
+                }
+            }
+            return best;
+        }, keymin, scan_grain(X.size()));
+        
+        best = comm.all2all_reduce_K(best, keymin);
+        if(!this->grow_tree(best)) {
+            break;
+        }
+    }
+    
+    //Print the Edges of the MST
+    if(comm.rank == 0) {
+        this->print_tree();
+    }
 }
-
-
-
@@ -15,92 +15,78 @@
 #include <set>
 #include <vector>
 #include <fstream>
+#include <string>
 
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
 #include <boost/iostreams/stream.hpp>
+#include "edgeArray.h"
+#include "graphGen.h"
 //#include "psim.h"
 
 
-struct Edge {
-    int e[2];
-    int weight;
-    
-    //Default constructor
-    Edge() {
-        e[0] = 0;
-        e[1] = 0;
-        weight = 0;
-    }
-    
-    //Overload constructor
-    Edge(int u, int v, int w) {
-        e[0] = u;
-        e[1] = v;
-        weight = w;
-    }
-    
-    //Overloaded equality operator. Tests for cummutativity.
-    bool operator==(const Edge& a) const {
-        return (
-                (e[0] == a.e[0] && e[1] == a.e[1]) ||
-                (e[0] == a.e[1] && e[1] == a.e[0])
-                );
-    }
-    
-    friend std::ostream& operator<<(std::ostream & os, const Edge& ed) {
-        os << ed.e[0] << " " << ed.e[1] << " (" << ed.weight << ") " << std::endl;
-        return os;
-    }
-    
-    void set(int u, int v, int w) {
-        e[0] = u;
-        e[1] = v;
-        weight = w;
-    }
-    
-    //Make Edge serializable via Boost
-    template<typename Archive>
-    void serialize(Archive& ar, const unsigned int version) {
-        ar & e;
-        ar & weight;
-    }
-};
-
-//Hash function for Edge objects (for use in the unordered set)
-struct HashEdge {
-    size_t operator()(const Edge &edge) const{
-        return std::hash<int>()(edge.e[0]) + std::hash<int>()(edge.e[1]) ;
-    }
-};
-
+class PSim;
+struct RankGroup;
+class ThreadPool;
 
 enum PrimEnum{
     SEQUENTIAL,
-    PARALLEL
+    PARALLEL,
+    DISTRIBUTED
 };
 
 
 class Prim {
 public:
     
-    Prim(const char* filename, PrimEnum, int);
+    Prim(const char* filename, PrimEnum, int, bool verbose = true);
+    Prim(const GraphSpec& spec, PrimEnum, int, bool verbose = true);
     ~Prim();
     void run();
+    void run(RankGroup& group);
     
     PrimEnum type;
     int nPsimProcs;
+    int nThreads;       //threads per rank for the local scans (default PSIM_THREADS)
+    int rank;           //this process's PSim rank after run(group) (0 after run())
+    bool verbose;
     int nVerts;
-    int nEdges;
-    int **adjMatrix;
-    std::set<int> X;
-    std::unordered_set<Edge, HashEdge> T;
+    long long nEdges;
+    int **adjMatrix;    //full nVerts x nVerts matrix (SEQUENTIAL/PARALLEL only)
+    
+    //MST output of run(): the tree edges as a flat array in the order they were added,
+    //and parent[v] = the tree neighbour through which v joined (-1 for the root 0)
+    EdgeArray T;
+    std::vector<int> parent;
+    
+    //vertices in the tree so far, in insertion order, plus a membership flag per vertex
+    std::vector<int> X;
+    std::vector<char> inX;
+    
+    //DISTRIBUTED only: this rank's block of rows [vBegin, vEnd) of the adjacency matrix,
+    //stored row-major as localRows[(k - vBegin) * nVerts + x]
+    int vBegin;
+    int vEnd;
+    int *localRows;
     
 private:
+    void init(PrimEnum typeIn, int nProcs, bool verboseIn);
+    void load_matrix();
+    void for_each_edge(const std::function<void(int, int, int)>& visit, ThreadPool* pool = nullptr);
     void run_sequential();
-    void run_parallel();
+    void run_session(PSim& comm);
+    void run_parallel(PSim& comm, ThreadPool& pool);
+    void run_distributed(PSim& comm, ThreadPool& pool);
+    void load_slice(PSim& comm, ThreadPool& pool);
+    void deliver(PSim& comm, std::vector<std::vector<int> >& outgoing);
+    void begin_tree();
+    bool grow_tree(EdgeKey best);
+    void print_tree() const;
+    
+    std::string filename;
+    GraphGenerator *generator;      //set when the graph comes from a GraphSpec instead of a file
     
 };
 
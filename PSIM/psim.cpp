@@ -6,19 +6,28 @@
  *  Ported from Massimo DiPierro's psim.py
  */
 
+#include <errno.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include <algorithm>
+#include <map>
+#include <sstream>
 #include "psim.h"
 
 /*
- * CONSTRUCTOR
- * params:  int p: # of processors
- *          std::function<bool(int, int, int)>& topo: a functor reference to a topology lambda
+ *  Process management shared by PSim and RankPool
  */
-PSim::PSim(int p, std::function<bool(int, int, int)>& topo) {
-    nprocs = p;
-    topology = topo;
-    
-    //dynamically allocate pipe_arr (to serve as a p x p matrix of pipes)
-    pipe_arr = new pipeFD*[p];
+
+//Allocate a p x p matrix of pipes; pipe_arr[i][j] carries messages from i to j
+static pipeFD** open_pipes(int p) {
+    pipeFD **pipe_arr = new pipeFD*[p];
     for(int i = 0; i < p; i++) {
         pipe_arr[i] = new pipeFD[p];
     }
@@ -27,29 +36,288 @@ PSim::PSim(int p, std::function<bool(int, int, int)>& topo) {
     for(int i = 0; i < p; i++) {
         for(int j = 0; j < p; j++) {
             pipeFD temp;
-            pipe(temp.fd);
+            if(pipe(temp.fd) != 0) {
+                perror("PSim pipe");
+            }
             pipe_arr[i][j] = temp;
         }
     }
-    this->rank = 0;
-    //printf("STARTING: process rank %d @ pid %d.\n", this->rank, getpid());
-    //fork n-1 processes
-    pid_t pid;
+    return pipe_arr;
+}
+
+static void close_pipes(int p, pipeFD **pipe_arr) {
+    for(int i = 0; i < p; i++) {
+        for(int j = 0; j < p; j++) {
+            close(pipe_arr[i][j].fd[0]);
+            close(pipe_arr[i][j].fd[1]);
+        }
+        delete [] pipe_arr[i];
+    }
+    delete [] pipe_arr;
+}
+
+/*
+ *  Vectors whose pages were vmspliced into a pipe (see PSim::_send_bulk). The pipe
+ *  references the pages themselves, so each vector is kept alive and unmodified until
+ *  the reader has drained that pipe. Keyed by the pipe's write end, which every
+ *  session on a pool shares.
+ */
+static std::map<int, std::vector<std::vector<int> > > g_inflight;
+
+//Free the vectors spliced into 'fd' once nothing is left unread in the pipe
+static void release_inflight(int fd) {
+    std::map<int, std::vector<std::vector<int> > >::iterator it = g_inflight.find(fd);
+    int unread = 0;
+    if(it != g_inflight.end() && ioctl(fd, FIONREAD, &unread) == 0 && unread == 0) {
+        g_inflight.erase(it);
+    }
+}
+
+/*
+ *  Free the vectors of every pipe that has drained. Called on each receive, so a rank
+ *  that sends bulk data and then only receives (a root collecting, a barrier) does
+ *  not hold on to it until its next bulk send down the same pipe.
+ */
+static void release_drained() {
+    std::map<int, std::vector<std::vector<int> > >::iterator it = g_inflight.begin();
+    while(it != g_inflight.end()) {
+        int unread = 0;
+        if(ioctl(it->first, FIONREAD, &unread) == 0 && unread == 0) {
+            g_inflight.erase(it++);
+        }
+        else {
+            it++;
+        }
+    }
+}
+
+//Drop every spliced vector of a pipe matrix; only once no rank can read them any more
+static void forget_inflight(int p, pipeFD **pipe_arr) {
+    for(int i = 0; i < p; i++) {
+        for(int j = 0; j < p; j++) {
+            g_inflight.erase(pipe_arr[i][j].fd[1]);
+        }
+    }
+}
+
+/*
+ *  Fork p-1 children and return this process's rank. Buffered output is flushed
+ *  first so the children do not inherit (and later print again) the parent's.
+ */
+static int fork_ranks(int p, std::vector<pid_t>& children) {
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(NULL);
     for(int i = 1; i < p; i++) {
-        if((pid = fork()) == 0) {
-            this->rank = i;
-            //printf("STARTING: process rank %d @ pid %d.\n", this->rank, getpid());
-            break;
+        pid_t pid = fork();
+        if(pid == 0) {
+            children.clear();
+            return i;
+        }
+        if(pid < 0) {
+            perror("PSim fork");
+            continue;
+        }
+        children.push_back(pid);
+    }
+    return 0;
+}
+
+/*
+ *  End of a forked group: every rank but 0 flushes its own output and exits here,
+ *  rank 0 reaps them and carries on with the caller's code.
+ */
+static void join_ranks(int rank, std::vector<pid_t>& children) {
+    if(rank != 0) {
+        std::cout.flush();
+        std::cerr.flush();
+        fflush(NULL);
+        _exit(0);
+    }
+    for(size_t i = 0; i < children.size(); i++) {
+        while(waitpid(children[i], NULL, 0) < 0 && errno == EINTR) {
         }
     }
+    children.clear();
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Fork the pool's p processes once. Each process pins itself (see psimPlacement.h)
+ *  and keeps its row and column of the pipe matrix for the sessions built on it.
+ */
+RankPool::RankPool(int p, const Placement& place) {
+    nprocs = p;
+    transport = "pipe";
+    placement = place;
+    cpuOf = placement.map(p, SWITCH);
+    pipe_arr = open_pipes(p);
+    Profiler::prepare(0, p);
+    rank = fork_ranks(p, children);
+    if(cpuOf[rank] >= 0) {
+        placement.pin(cpuOf[rank]);
+    }
+    outFd.resize(p);
+    inFd.resize(p);
+    for(int j = 0; j < p; j++) {
+        outFd[j] = pipe_arr[rank][j].fd[1];
+        inFd[j] = pipe_arr[j][rank].fd[0];
+    }
+}
+
+//Join the pool: workers exit here, rank 0 returns once they all have
+RankPool::~RankPool() {
+    if(rank == 0) {
+        placement.unpin();
+    }
+    join_ranks(rank, children);
+    forget_inflight(nprocs, pipe_arr);
+    close_pipes(nprocs, pipe_arr);
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ * CONSTRUCTOR
+ * params:  int p: # of processors
+ *          std::function<bool(int, int, int)>& topo: a functor reference to a topology lambda
+ *          const Placement& place: CPU/NUMA placement of the ranks (default: PSIM_PLACEMENT)
+ *
+ * A standalone session forks its own p-1 processes and joins them in the destructor;
+ * only rank 0 returns from it.
+ */
+PSim::PSim(int p, std::function<bool(int, int, int)>& topo, const Placement& place) {
+    nprocs = p;
+    topology = topo;
+    placement = place;
+    cpuOf = placement.map(p, topo);
+    owner = true;
+    
+    pipe_arr = open_pipes(p);
+    Profiler::prepare(0, p);
+    this->rank = fork_ranks(p, children);
+    
+    //every process, rank 0 included, pins itself once the fork is done
+    if(cpuOf[this->rank] >= 0) {
+        this->placement.pin(cpuOf[this->rank]);
+    }
+    outFd.resize(p);
+    inFd.resize(p);
+    members.resize(p);
+    for(int j = 0; j < p; j++) {
+        outFd[j] = pipe_arr[this->rank][j].fd[1];
+        inFd[j] = pipe_arr[j][this->rank].fd[0];
+        members[j] = j;
+    }
+    groupOf = members;
+    this->codec = CodecPolicy::from_env();
+    this->epollFd = -1;
+    this->prof.start(this->rank, this->nprocs, this->groupOf);
+}
+
+/*
+ *  Session over every rank of 'group' (a RankPool or a SocketMesh). Nothing is forked
+ *  or opened: the session uses the group's channels, so it costs no more than filling
+ *  in the channel tables.
+ */
+PSim::PSim(RankGroup& group, std::function<bool(int, int, int)>& topo) : PSim(group, std::vector<int>(), topo) {
+}
+
+/*
+ *  Session over the group ranks listed in 'members' (all of them if empty). Rank j of
+ *  the session is group rank members[j]. Only members may construct it, and they must
+ *  all do so; messages between two ranks arrive in the order they were sent whatever
+ *  session they belong to, so every rank must use its sessions in the same order.
+ */
+PSim::PSim(RankGroup& group, const std::vector<int>& memberList, std::function<bool(int, int, int)>& topo) {
+    topology = topo;
+    members = memberList;
+    if(members.empty()) {
+        for(int j = 0; j < group.nprocs; j++) {
+            members.push_back(j);
+        }
+    }
+    std::vector<int> identity(group.nprocs);
+    for(int j = 0; j < group.nprocs; j++) {
+        identity[j] = j;
+    }
+    this->attach(group.outFd, group.inFd, group.rank, group.cpuOf, group.placement, identity);
+}
+
+/*
+ *  Sub-session over the ranks of 'parent' listed in 'members' (ranks of the parent)
+ */
+PSim::PSim(PSim& parent, const std::vector<int>& memberList, std::function<bool(int, int, int)>& topo) {
+    topology = topo;
+    members = memberList;
+    this->attach(parent.outFd, parent.inFd, parent.rank, parent.cpuOf, parent.placement, parent.groupOf);
+}
+
+//Build the channel tables of a session that borrows its parent's pipes
+void PSim::attach(const std::vector<int>& parentOut, const std::vector<int>& parentIn, int parentRank,
+                  const std::vector<int>& parentCpus, const Placement& parentPlacement,
+                  const std::vector<int>& parentGroupOf) {
+    owner = false;
+    pipe_arr = nullptr;
+    nprocs = static_cast<int>(members.size());
+    placement = parentPlacement;
+    rank = -1;
+    outFd.resize(nprocs);
+    inFd.resize(nprocs);
+    cpuOf.resize(nprocs);
+    groupOf.resize(nprocs);
+    for(int j = 0; j < nprocs; j++) {
+        outFd[j] = parentOut[members[j]];
+        inFd[j] = parentIn[members[j]];
+        cpuOf[j] = parentCpus[members[j]];
+        groupOf[j] = parentGroupOf[members[j]];
+        if(members[j] == parentRank) {
+            rank = j;
+        }
+    }
+    if(rank < 0) {
+        std::cerr << "PSim: rank " << parentRank << " is not a member of the session it is creating\n";
+    }
+    this->codec = CodecPolicy::from_env();
+    this->epollFd = -1;
+    this->prof.start(this->rank, this->nprocs, this->groupOf);
 }
 
 //DESTRUCTOR
 PSim::~PSim() {
-    for(int i = 0; i < this->nprocs; i++) {
-        delete [] pipe_arr[i];
+    this->prof.dump();
+    if(this->epollFd >= 0) {
+        close(this->epollFd);
     }
-    delete [] pipe_arr;
+    if(!this->owner) {
+        return;
+    }
+    //rank 0 is the caller's own process: give it back its original affinity
+    if(this->rank == 0) {
+        this->placement.unpin();
+    }
+    //the workers may still be reading what rank 0 spliced, so the pipes and the
+    //vectors behind them go only once every worker has exited
+    join_ranks(this->rank, this->children);
+    forget_inflight(this->nprocs, this->pipe_arr);
+    close_pipes(this->nprocs, this->pipe_arr);
+}
+
+/*
+ *  Turn on the communication profiler for this rank (see psimProfiler.h). Counters
+ *  and, with 'timeline', per-event records are written to <prefix>.<pool rank>.prof
+ *  when this PSim is destroyed.
+ */
+void PSim::profile(const std::string& prefix, bool timeline) {
+    this->prof.enable(prefix, timeline);
+}
+
+/*
+ *  Print the rank -> CPU/core/socket/node mapping chosen for this PSim
+ */
+void PSim::placement_report(std::ostream& os) const {
+    this->placement.report(os, this->cpuOf);
 }
 
 //------------------------------------------------------------------------------------------------
@@ -57,32 +325,395 @@ PSim::~PSim() {
  * CLASS METHODS:
  */
 
+/*
+ *  Message framing. Every message is a 4 byte length followed by the serialized
+ *  payload, and the receiver reads exactly that many bytes. Reading a Boost archive
+ *  straight from the pipe let the stream buffer swallow the start of the next
+ *  message whenever two were queued on the same pipe.
+ */
+
+/*
+ *  writev() until every buffer is out. Header and payload leave in one call, so a
+ *  small message costs one syscall and, on a TCP_NODELAY socket, one segment.
+ */
+static void writev_all(int fd, struct iovec* iov, int count) {
+    while(count > 0) {
+        ssize_t w = writev(fd, iov, count);
+        if(w < 0) {
+            if(errno == EINTR) continue;
+            perror("PSim writev");
+            return;
+        }
+        size_t n = static_cast<size_t>(w);
+        while(count > 0 && n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+//read() until all n bytes are in, retrying on partial reads and EINTR
+static void read_all(int fd, char* buf, size_t n) {
+    while(n > 0) {
+        ssize_t r = read(fd, buf, n);
+        if(r < 0) {
+            if(errno == EINTR) continue;
+            perror("PSim read");
+            return;
+        }
+        if(r == 0) {
+            std::cerr << "PSim read: unexpected end of channel\n";
+            return;
+        }
+        buf += r;
+        n -= static_cast<size_t>(r);
+    }
+}
+
+static bool is_pipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+#ifdef __linux__
+//vmsplice() as much of buf as the kernel takes; returns the bytes spliced
+static size_t vmsplice_all(int fd, const char* buf, size_t n) {
+    size_t done = 0;
+    while(done < n) {
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>(buf + done);
+        iov.iov_len = n - done;
+        ssize_t w = vmsplice(fd, &iov, 1, 0);
+        if(w < 0) {
+            if(errno == EINTR) continue;
+            break;
+        }
+        done += static_cast<size_t>(w);
+    }
+    return done;
+}
+#endif
+
+void PSim::_write_frame(int j, const std::string& payload) {
+    long long t0 = this->prof.enabled ? Profiler::now_ns() : 0;
+    uint32_t len = static_cast<uint32_t>(payload.size());
+    int fd = this->outFd[j];
+    {
+        PhaseTimer pt(this->prof, PROF_SYSCALL);
+        struct iovec iov[2];
+        iov[0].iov_base = &len;
+        iov[0].iov_len = sizeof(len);
+        iov[1].iov_base = const_cast<char*>(payload.data());
+        iov[1].iov_len = payload.size();
+        writev_all(fd, iov, 2);
+    }
+    if(this->prof.enabled) {
+        this->prof.add_message(true, j, sizeof(len) + payload.size(), t0);
+    }
+}
+
+std::string PSim::_read_frame(int j) {
+    long long t0 = this->prof.enabled ? Profiler::now_ns() : 0;
+    uint32_t len = 0;
+    int fd = this->inFd[j];
+    if(!g_inflight.empty()) {
+        release_drained();
+    }
+    if(this->prof.enabled) {
+        //time spent blocked before the first byte arrives is waiting, not I/O
+        PhaseTimer pt(this->prof, PROF_WAIT);
+        struct pollfd pfd = {fd, POLLIN, 0};
+        while(poll(&pfd, 1, -1) < 0 && errno == EINTR) {
+        }
+    }
+    std::string payload;
+    {
+        PhaseTimer pt(this->prof, PROF_SYSCALL);
+        read_all(fd, reinterpret_cast<char*>(&len), sizeof(len));
+        payload.resize(len);
+        read_all(fd, &payload[0], len);
+    }
+    if(this->prof.enabled) {
+        this->prof.add_message(false, j, sizeof(len) + len, t0);
+    }
+    return payload;
+}
+
+/*
+ *  The ranks a collective still expects a message from, handed out in the order their
+ *  messages arrive, so one slow rank does not hold up the ones that are done. On Linux
+ *  the pending channels join the session's epoll set for the length of the collective
+ *  and leave it as they are read (a rank that has already delivered may send its
+ *  next message early, and must not wake us up again); elsewhere, or if epoll is not
+ *  available, poll() over the pending channels.
+ */
+class Arrivals {
+public:
+    Arrivals(PSim& comm, const std::vector<int>& sources);
+    ~Arrivals();
+    int next();
+    
+private:
+    bool take(int j);
+    
+    PSim& comm;
+    std::vector<int> pending;
+    std::vector<int> ready;     //reported ready by the last epoll_wait, not yet handed out
+    bool useEpoll;
+};
+
+//Every rank of a p-process session except r
+static std::vector<int> all_but(int p, int r) {
+    std::vector<int> ranks;
+    for(int j = 0; j < p; j++) {
+        if(j != r) {
+            ranks.push_back(j);
+        }
+    }
+    return ranks;
+}
+
+Arrivals::Arrivals(PSim& commIn, const std::vector<int>& sources) : comm(commIn), pending(sources), useEpoll(false) {
+#ifdef __linux__
+    if(comm.epollFd < 0) {
+        comm.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    }
+    useEpoll = comm.epollFd >= 0;
+    for(size_t i = 0; i < pending.size() && useEpoll; i++) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = static_cast<uint32_t>(pending[i]);
+        if(epoll_ctl(comm.epollFd, EPOLL_CTL_ADD, comm.inFd[pending[i]], &ev) != 0) {
+            //e.g. two sources sharing a channel; fall back to poll for this collective
+            for(size_t k = 0; k < i; k++) {
+                epoll_ctl(comm.epollFd, EPOLL_CTL_DEL, comm.inFd[pending[k]], NULL);
+            }
+            useEpoll = false;
+        }
+    }
+#endif
+}
+
+Arrivals::~Arrivals() {
+#ifdef __linux__
+    for(size_t i = 0; i < pending.size() && useEpoll; i++) {
+        epoll_ctl(comm.epollFd, EPOLL_CTL_DEL, comm.inFd[pending[i]], NULL);
+    }
+#endif
+}
+
+//Remove j from the pending ranks; false if it was not pending
+bool Arrivals::take(int j) {
+    std::vector<int>::iterator it = std::find(pending.begin(), pending.end(), j);
+    if(it == pending.end()) {
+        return false;
+    }
+    pending.erase(it);
+#ifdef __linux__
+    if(useEpoll) {
+        epoll_ctl(comm.epollFd, EPOLL_CTL_DEL, comm.inFd[j], NULL);
+    }
+#endif
+    return true;
+}
+
+//The next pending rank with a message waiting (blocking until there is one); -1 when none is left
+int Arrivals::next() {
+    while(!pending.empty()) {
+        while(!ready.empty()) {
+            int j = ready.front();
+            ready.erase(ready.begin());
+            if(take(j)) {
+                return j;
+            }
+        }
+        PhaseTimer pt(comm.prof, PROF_WAIT);
+#ifdef __linux__
+        if(useEpoll) {
+            struct epoll_event evs[64];
+            int n = epoll_wait(comm.epollFd, evs, 64, -1);
+            for(int i = 0; i < n; i++) {
+                ready.push_back(static_cast<int>(evs[i].data.u32));
+            }
+            continue;
+        }
+#endif
+        std::vector<struct pollfd> pfds(pending.size());
+        for(size_t i = 0; i < pending.size(); i++) {
+            pfds[i].fd = comm.inFd[pending[i]];
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+        if(poll(&pfds[0], pfds.size(), -1) > 0) {
+            for(size_t i = 0; i < pfds.size(); i++) {
+                if(pfds[i].revents != 0) {
+                    ready.push_back(pending[i]);
+                }
+            }
+        }
+    }
+    return -1;
+}
+
 /*
  * Send integer data to process j. (TODO: Templates/generics)
  */
 
 //Serialize plain int data and send to process j
 void PSim::_send(int j, int data) {
-    boost::iostreams::stream_buffer<boost::iostreams::file_descriptor_sink> sbw((this->pipe_arr[this->rank][j]).fd[1], boost::iostreams::never_close_handle);
-    std::ostream os(&sbw);
-    boost::archive::text_oarchive oa(os);
-    oa << data;
+    std::ostringstream os;
+    {
+        PhaseTimer pt(this->prof, PROF_SERIALIZE);
+        boost::archive::text_oarchive oa(os);
+        oa << data;
+    }
+    _write_frame(j, os.str());
+}
+
+//Serialize vector<int> and send to process j. Vectors above the codec threshold
+//go out as a binary frame in the smallest codec (see psimCodec.h), and vectors above
+//the bulk threshold without serializing at all. Into a pipe a bulk transfer always
+//wins: the message is a memory copy there, cheaper than encoding and decoding it.
+//A vector passed as an rvalue may be parked for a bulk transfer (see _send_bulk), and
+//is left empty then; one passed by reference is copied only if it has to be parked.
+void PSim::_send_vector(int j, const std::vector<int>& data) {
+    send_vector(j, data, nullptr);
+}
+
+void PSim::_send_vector(int j, std::vector<int>&& data) {
+    send_vector(j, data, &data);
+}
+
+void PSim::send_vector(int j, const std::vector<int>& data, std::vector<int>* owned) {
+    size_t n = data.size();
+    if(this->codec.bulk(n) && (!this->codec.applies(n) || is_pipe(this->outFd[j]))) {
+        _send_bulk(j, data, owned);
+        return;
+    }
+    if(this->codec.applies(n)) {
+        std::string frame;
+        {
+            PhaseTimer pt(this->prof, PROF_SERIALIZE);
+            long long t0 = this->prof.enabled ? Profiler::now_ns() : 0;
+            VectorCodec c = this->codec.choose(data);
+            if(c != CODEC_RAW || !this->codec.bulk(n)) {
+                encode_vector(data, c, frame);
+                if(this->prof.enabled) {
+                    this->prof.add_codec(CODEC_NAMES[c], j, sizeof(int) * n, frame.size(), t0);
+                }
+            }
+        }
+        if(frame.empty()) {
+            //large and incompressible: a socket gets it as it is
+            _send_bulk(j, data, owned);
+        }
+        else {
+            _write_frame(j, frame);
+        }
+        return;
+    }
+    std::ostringstream os;
+    {
+        PhaseTimer pt(this->prof, PROF_SERIALIZE);
+        boost::archive::text_oarchive oa(os);
+        oa << data;
+    }
+    _write_frame(j, os.str());
 }
 
-//Serialize vector<int> and send to process j
-void PSim::_send_vector(int j, std::vector<int> data) {
-    boost::iostreams::stream_buffer<boost::iostreams::file_descriptor_sink> sbw((this->pipe_arr[this->rank][j]).fd[1], boost::iostreams::never_close_handle);
-    std::ostream os(&sbw);
-    boost::archive::text_oarchive oa(os);
-    oa << data;
+/*
+ *  Bulk transfer: a bulk header frame, then the ints straight from 'data'. Into a pipe
+ *  the pages are vmspliced, so the receiver's read() is the only copy, and the vector
+ *  is parked until the pipe drains: 'owned' (which is 'data') is swapped out, leaving
+ *  the caller an empty vector, and without it 'data' is copied. Sockets, and systems
+ *  without vmsplice, get a write() from the caller's memory.
+ */
+void PSim::_send_bulk(int j, const std::vector<int>& data, std::vector<int>* owned) {
+    long long t0 = this->prof.enabled ? Profiler::now_ns() : 0;
+    int fd = this->outFd[j];
+    std::string header = bulk_header(data.size());
+    uint32_t len = static_cast<uint32_t>(header.size());
+    const char* buf = reinterpret_cast<const char*>(data.data());
+    size_t n = sizeof(int) * data.size();
+    {
+        PhaseTimer pt(this->prof, PROF_SYSCALL);
+        struct iovec iov[3];
+        iov[0].iov_base = &len;
+        iov[0].iov_len = sizeof(len);
+        iov[1].iov_base = &header[0];
+        iov[1].iov_len = header.size();
+        iov[2].iov_base = const_cast<char*>(buf);
+        iov[2].iov_len = n;
+#ifdef __linux__
+        if(is_pipe(fd)) {
+            release_inflight(fd);
+            writev_all(fd, iov, 2);
+            //swap keeps the storage where it is; a copy moves 'buf' to the parked one
+            std::vector<std::vector<int> >& parked = g_inflight[fd];
+            parked.push_back(std::vector<int>());
+            if(owned != nullptr) {
+                parked.back().swap(*owned);
+            }
+            else {
+                parked.back() = data;
+                buf = reinterpret_cast<const char*>(parked.back().data());
+            }
+            size_t spliced = vmsplice_all(fd, buf, n);
+            iov[2].iov_base = const_cast<char*>(buf + spliced);
+            iov[2].iov_len = n - spliced;
+            writev_all(fd, iov + 2, 1);
+        }
+        else
+#endif
+        {
+            writev_all(fd, iov, 3);
+        }
+    }
+    if(this->prof.enabled) {
+        this->prof.add_message(true, j, sizeof(len) + header.size() + n, t0);
+    }
 }
 
-//Serialize Edge and send to process j
-void PSim::_send_Edge(int j, Edge data) {
-    boost::iostreams::stream_buffer<boost::iostreams::file_descriptor_sink> sbw((this->pipe_arr[this->rank][j]).fd[1], boost::iostreams::never_close_handle);
-    std::ostream os(&sbw);
-    boost::archive::text_oarchive oa(os);
-    oa << data;
+//First byte of an Edge frame: a packed EdgeKey follows, or the full Edge archive
+static const char EDGE_FRAME_KEY = 'K';
+static const char EDGE_FRAME_FULL = 'E';
+
+//Send Edge to process j. Edges that fit an EdgeKey (see edgeArray.h) travel packed as
+//one integer; any other edge falls back to the three-field archive, so no vertex id
+//or weight is ever truncated on the way
+void PSim::_send_Edge(int j, const Edge& data) {
+    std::ostringstream os;
+    {
+        PhaseTimer pt(this->prof, PROF_SERIALIZE);
+        if(packable(data.e[0], data.e[1], data.weight)) {
+            os << EDGE_FRAME_KEY;
+            boost::archive::text_oarchive oa(os);
+            EdgeKey key = pack_edge(data);
+            oa << key;
+        }
+        else {
+            os << EDGE_FRAME_FULL;
+            boost::archive::text_oarchive oa(os);
+            oa << data;
+        }
+    }
+    _write_frame(j, os.str());
+}
+
+//Serialize packed EdgeKey and send to process j
+void PSim::_send_key(int j, EdgeKey data) {
+    std::ostringstream os;
+    {
+        PhaseTimer pt(this->prof, PROF_SERIALIZE);
+        boost::archive::text_oarchive oa(os);
+        oa << data;
+    }
+    _write_frame(j, os.str());
 }
 
 void PSim::send(int j, int data) {
@@ -103,33 +734,97 @@ void PSim::send(int j, int data) {
 //De-serialize plain int data from process j
 int PSim::_recv(int j) {
     int tmp;
-    boost::iostreams::stream_buffer<boost::iostreams::file_descriptor_source> sbr((this->pipe_arr[j][this->rank]).fd[0], boost::iostreams::never_close_handle);
-    std::istream is(&sbr);
-    boost::archive::text_iarchive ia(is);
-    ia >> tmp;
+    std::string frame = _read_frame(j);
+    {
+        PhaseTimer pt(this->prof, PROF_SERIALIZE);
+        std::istringstream is(frame);
+        boost::archive::text_iarchive ia(is);
+        ia >> tmp;
+    }
     return tmp;
 }
 
 //De-serialize vector<int> from process j
 std::vector<int> PSim::_recv_vector(int j) {
     std::vector<int> outvect;
-    boost::iostreams::stream_buffer<boost::iostreams::file_descriptor_source> sbr((this->pipe_arr[j][this->rank]).fd[0], boost::iostreams::never_close_handle);
-    std::istream is(&sbr);
-    boost::archive::text_iarchive ia(is);
-    ia >> outvect;
+    _recv_vector_into(j, outvect);
     return outvect;
 }
 
-//De-serialize Edge from process j
+/*
+ *  Receive a vector<int> from process j into 'out', reusing its storage. A bulk
+ *  transfer is read straight into it: one copy out of the kernel, no parsing.
+ */
+void PSim::_recv_vector_into(int j, std::vector<int>& out) {
+    std::string frame = _read_frame(j);
+    size_t n = 0;
+    bool swapped = false;
+    if(is_bulk_header(frame, n, swapped)) {
+        _read_bulk(j, n, swapped, out);
+        return;
+    }
+    PhaseTimer pt(this->prof, PROF_SERIALIZE);
+    if(is_encoded_frame(frame)) {
+        decode_vector(frame, out);
+        return;
+    }
+    std::istringstream is(frame);
+    boost::archive::text_iarchive ia(is);
+    ia >> out;
+}
+
+//The n ints that follow a bulk header on the channel from process j
+void PSim::_read_bulk(int j, size_t n, bool swapped, std::vector<int>& out) {
+    out.resize(n);
+    {
+        PhaseTimer pt(this->prof, PROF_SYSCALL);
+        read_all(this->inFd[j], reinterpret_cast<char*>(out.data()), sizeof(int) * n);
+    }
+    if(swapped) {
+        for(size_t i = 0; i < n; i++) {
+            uint32_t v = static_cast<uint32_t>(out[i]);
+            out[i] = static_cast<int>((v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24));
+        }
+    }
+    if(this->prof.enabled) {
+        this->prof.add_payload(false, j, sizeof(int) * n);
+    }
+}
+
+//Receive an Edge from process j, packed or not
 Edge PSim::_recv_Edge(int j) {
     Edge outEdge;
-    boost::iostreams::stream_buffer<boost::iostreams::file_descriptor_source> sbr((this->pipe_arr[j][this->rank]).fd[0], boost::iostreams::never_close_handle);
-    std::istream is(&sbr);
-    boost::archive::text_iarchive ia(is);
-    ia >> outEdge;
+    std::string frame = _read_frame(j);
+    {
+        PhaseTimer pt(this->prof, PROF_SERIALIZE);
+        std::istringstream is(frame);
+        char tag = static_cast<char>(is.get());
+        boost::archive::text_iarchive ia(is);
+        if(tag == EDGE_FRAME_KEY) {
+            EdgeKey key;
+            ia >> key;
+            outEdge = unpack_edge(key);
+        }
+        else {
+            ia >> outEdge;
+        }
+    }
     return outEdge;
 }
 
+//De-serialize packed EdgeKey from process j
+EdgeKey PSim::_recv_key(int j) {
+    EdgeKey outKey;
+    std::string frame = _read_frame(j);
+    {
+        PhaseTimer pt(this->prof, PROF_SERIALIZE);
+        std::istringstream is(frame);
+        boost::archive::text_iarchive ia(is);
+        ia >> outKey;
+    }
+    return outKey;
+}
+
 int PSim::recv(int j) {
     if(this->topology(this->rank, j, this->nprocs)) {
         return _recv(j);
@@ -139,6 +834,23 @@ int PSim::recv(int j) {
         return -1;
     }
 }
+
+/*
+ *  Receive an int from whichever of 'sources' gets its message in first. Returns
+ *  (source, value). A rank that has already been heard from may send its next message
+ *  early, so a caller waiting for one message from each rank should drop ranks from
+ *  'sources' as it hears from them.
+ */
+std::pair<int, int> PSim::recv_any(const std::vector<int>& sources) {
+    Arrivals arrivals(*this, sources);
+    int j = arrivals.next();
+    return std::make_pair(j, (j >= 0) ? _recv(j) : 0);
+}
+
+//recv_any from every other rank
+std::pair<int, int> PSim::recv_any() {
+    return recv_any(all_but(this->nprocs, this->rank));
+}
 //------------------------------------------------------------------------------------------------
 
 /*
@@ -149,6 +861,7 @@ int PSim::recv(int j) {
  *  Broadcast int 'value' to all processes from process 'source'
  */
 int PSim::one2all_broadcast(int source, int value) {
+    CallTimer ct(this->prof, "one2all_broadcast");
     if(this->rank == source) {
         for(int i = 0; i < this->nprocs; i++) {
             if(!(i == source)) {
@@ -166,16 +879,33 @@ int PSim::one2all_broadcast(int source, int value) {
  *  Broadcast EDGE 'value' to all processes from process 'source'
  *  TODO: omit and implement generics/Templates
  */
-Edge PSim::one2all_broadcast_E(int source, Edge value) {
+Edge PSim::one2all_broadcast_E(int source, const Edge& value) {
+    CallTimer ct(this->prof, "one2all_broadcast_E");
     if(this->rank == source) {
         for(int i = 0; i < this->nprocs; i++) {
             if(!(i == source)) {
                 this->_send_Edge(i, value);
             }
         }
+        return value;
+    }
+    return this->_recv_Edge(source);
+}
+
+/*
+ *  Broadcast packed EdgeKey 'value' to all processes from process 'source'
+ */
+EdgeKey PSim::one2all_broadcast_K(int source, EdgeKey value) {
+    CallTimer ct(this->prof, "one2all_broadcast_K");
+    if(this->rank == source) {
+        for(int i = 0; i < this->nprocs; i++) {
+            if(!(i == source)) {
+                this->_send_key(i, value);
+            }
+        }
     }
     else {
-        value = this->_recv_Edge(source);
+        value = this->_recv_key(source);
     }
     return value;
 }
@@ -184,14 +914,16 @@ Edge PSim::one2all_broadcast_E(int source, Edge value) {
  *  Broadcast int 'value' to all processes and returns a vector of each process's value
  */
 std::vector<int> PSim::all2all_broadcast(int value) {
+    CallTimer ct(this->prof, "all2all_broadcast");
     std::vector<int> vect, ret_vect;
     vect.resize(this->nprocs);
     ret_vect.resize(this->nprocs);
     vect = all2one_collect(0, value);
     if(this->rank == 0) {
-        for(int i = 0; i < this->nprocs; i++) {
+        for(int i = 0; i < this->nprocs - 1; i++) {
             _send_vector(i, vect);
         }
+        _send_vector(this->nprocs - 1, std::move(vect));
     }
     ret_vect = _recv_vector(0);
     return ret_vect;
@@ -203,41 +935,107 @@ std::vector<int> PSim::all2all_broadcast(int value) {
  *  vector<int> to each process
  */
 std::vector<int> PSim::one2all_scatter(int source, std::vector<int> data) {
-    if(this->rank == source) {
-        int h = (int)data.size() / this->nprocs;
-        int r = (int)data.size() % this->nprocs;
-        if(r != 0) {
-            h++;
+    CallTimer ct(this->prof, "one2all_scatter");
+    if(this->rank != source) {
+        return _recv_vector(source);
+    }
+    int h = (int)data.size() / this->nprocs;
+    int r = (int)data.size() % this->nprocs;
+    if(r != 0) {
+        h++;
+    }
+    //the last vector is often shorter than the previous ones, so it takes whatever is
+    //left to ensure we aren't overshooting the iterator and sending 0s. The source's
+    //own slice never goes through its pipe: a self-send larger than the pipe buffer
+    //would block before anyone reads it.
+    std::vector<int> outvect;
+    for(int i = 0; i < this->nprocs; i++) {
+        size_t begin = std::min(data.size(), (size_t)i * h);
+        size_t end = (i == this->nprocs-1) ? data.size() : std::min(data.size(), (size_t)(i+1) * h);
+        std::vector<int> tv(data.begin() + begin, data.begin() + end);
+        if(i == source) {
+            outvect.swap(tv);
         }
-        for(int i = 0; i < this->nprocs-1; i++) {
-            std::vector<int> tv( data.begin() + (i*h), data.begin() +(i*h) + (h) );
-            _send_vector(i, tv);
+        else {
+            _send_vector(i, std::move(tv));
         }
-        //the last vector is often shorter than the previous ones, so we manually send the last
-        //vector to ensure we aren't overshooting the iterator and sending 0s
-        std::vector<int> tvl( data.begin() + ((this->nprocs-1)*h), data.end() );
-        _send_vector((this->nprocs-1), tvl);
     }
-    std::vector<int> outvect = _recv_vector(source);
     return outvect;
 }
 
 
+/*
+ *  Partner of rank 'r' in round 'round' of a round-robin tournament over p ranks
+ *  (p rounds for odd p, p-1 for even), or -1 if r sits the round out. Every pair of
+ *  ranks meets exactly once.
+ */
+static int exchange_partner(int p, int round, int r) {
+    int n = p + (p % 2);        //odd p gets a dummy rank n-1
+    int m = n - 1;
+    int partner;
+    if(r == m) {
+        partner = (round % 2 == 0) ? round / 2 : (round + m) / 2;
+    }
+    else {
+        partner = (round - r + m) % m;
+        if(partner == r) {
+            partner = m;
+        }
+    }
+    return (partner < p) ? partner : -1;
+}
+
+/*
+ *  Personalized all-to-all: parts[j] is sent to rank j, and the result holds in slot j
+ *  what rank j sent to this one. Parts are raw byte frames, so any trivially copyable
+ *  data can be packed into them. The exchange runs as a round-robin tournament: in
+ *  each round ranks meet in pairs, the lower rank of a pair writes first and then
+ *  reads, the higher reads first. Every write therefore has a reader on the other end
+ *  and no frame size can deadlock the pipes, unlike everyone sending before anyone
+ *  receives.
+ */
+std::vector<std::string> PSim::all2all_personalized(std::vector<std::string> parts) {
+    CallTimer ct(this->prof, "all2all_personalized");
+    std::vector<std::string> received(this->nprocs);
+    received[this->rank].swap(parts[this->rank]);
+    int rounds = this->nprocs - 1 + (this->nprocs % 2);
+    for(int round = 0; round < rounds; round++) {
+        int j = exchange_partner(this->nprocs, round, this->rank);
+        if(j < 0) {
+            continue;
+        }
+        if(this->rank < j) {
+            _write_frame(j, parts[j]);
+            received[j] = _read_frame(j);
+        }
+        else {
+            received[j] = _read_frame(j);
+            _write_frame(j, parts[j]);
+        }
+        std::string().swap(parts[j]);
+    }
+    return received;
+}
+
+
 /*
  *  Collect gathers values (input int 'data') from each process and stores them in a
  *  vector<int> ordered by process at the process specified by 'destination'
  */
 std::vector<int> PSim::all2one_collect(int destination, int data) {
-    _send(destination, data);
+    CallTimer ct(this->prof, "all2one_collect");
     std::vector<int> collection_by_rank;
-    collection_by_rank.resize(this->nprocs);
-    if(this->rank == destination) {
-        for(int i = 0; i < this->nprocs; i++) {
-            collection_by_rank[i] = _recv(i);
-        }
+    if(this->rank != destination) {
+        _send(destination, data);
+        return collection_by_rank;
     }
-    else {
-        collection_by_rank.clear();
+    //the destination's own value never goes through its pipe; the others are read
+    //in the order they arrive
+    collection_by_rank.resize(this->nprocs);
+    collection_by_rank[destination] = data;
+    Arrivals arrivals(*this, all_but(this->nprocs, destination));
+    for(int i = arrivals.next(); i >= 0; i = arrivals.next()) {
+        collection_by_rank[i] = _recv(i);
     }
     return collection_by_rank;
 }
@@ -246,51 +1044,64 @@ std::vector<int> PSim::all2one_collect(int destination, int data) {
 /*
  *  All to one reduction returning the reduction of each process's 'value' using
  *  the functor 'binop'. The result is stored is process 'destination.'
+ *  Contributions are read as they arrive but folded in rank order, so 'binop' need
+ *  not be commutative.
  */
 int PSim::all2one_reduce(int destination, int value, std::function<int(int, int)>& binop) {
-    this->_send(destination, value);
-    std::vector<int> v;
-    int result;
-    if(this->rank == destination) {
-        for(int i = 0; i < this->nprocs; i++) {
-            int tmp = this->_recv(i);
-            v.push_back(tmp);
-        }
-        result = std::accumulate(std::begin(v)+1, std::end(v), *std::begin(v), binop);
+    CallTimer ct(this->prof, "all2one_reduce");
+    if(this->rank != destination) {
+        this->_send(destination, value);
+        return 0;
     }
-    else {
-        result = 0;
+    std::vector<int> v(this->nprocs);
+    v[destination] = value;
+    Arrivals arrivals(*this, all_but(this->nprocs, destination));
+    for(int i = arrivals.next(); i >= 0; i = arrivals.next()) {
+        v[i] = this->_recv(i);
     }
-    return result;
+    return std::accumulate(std::begin(v)+1, std::end(v), *std::begin(v), binop);
 }
 
 /*
  *  Reduction of each process's EDGE WEIGHT using (Edge, Edge) => Edge
  *  the functor 'binop'. The result is stored is process 'destination.'
+ *  Edges travel packed where they fit (see _send_Edge); 'binop' always sees and
+ *  returns full Edges, folded in rank order.
  */
-Edge PSim::all2one_reduce_E(int destination, Edge value, std::function<Edge(Edge, Edge)>& binop) {
-    //Send if this process isn't the dest
-    if (this->rank != destination) {
+Edge PSim::all2one_reduce_E(int destination, const Edge& value, std::function<Edge(const Edge&, const Edge&)>& binop) {
+    CallTimer ct(this->prof, "all2one_reduce_E");
+    if(this->rank != destination) {
         this->_send_Edge(destination, value);
+        return Edge();
     }
-    std::vector<Edge> v;
-    Edge result;
-    if(this->rank == destination) {
-        for(int i = 0; i < this->nprocs; i++) {
-            if (i == destination) {
-                v.push_back(value);
-            }
-            else{
-                Edge tmp = this->_recv_Edge(i);
-                v.push_back(tmp);
-            }
-        }
-        result = std::accumulate(std::begin(v)+1, std::end(v), *std::begin(v), binop);
+    std::vector<Edge> v(this->nprocs);
+    v[destination] = value;
+    Arrivals arrivals(*this, all_but(this->nprocs, destination));
+    for(int i = arrivals.next(); i >= 0; i = arrivals.next()) {
+        v[i] = this->_recv_Edge(i);
     }
-    else {
-        result = Edge();
+    return std::accumulate(std::begin(v)+1, std::end(v), *std::begin(v), binop);
+}
+
+/*
+ *  Reduction of each process's packed EdgeKey using the functor 'binop'
+ *  (e.g. keymin). The result is stored is process 'destination.'
+ *  Keys are read as they arrive and folded in rank order.
+ */
+EdgeKey PSim::all2one_reduce_K(int destination, EdgeKey value, std::function<EdgeKey(EdgeKey, EdgeKey)>& binop) {
+    CallTimer ct(this->prof, "all2one_reduce_K");
+    //Send if this process isn't the dest
+    if (this->rank != destination) {
+        this->_send_key(destination, value);
+        return EDGE_KEY_NONE;
+    }
+    std::vector<EdgeKey> v(this->nprocs);
+    v[destination] = value;
+    Arrivals arrivals(*this, all_but(this->nprocs, destination));
+    for(int i = arrivals.next(); i >= 0; i = arrivals.next()) {
+        v[i] = this->_recv_key(i);
     }
-    return result;
+    return std::accumulate(std::begin(v)+1, std::end(v), *std::begin(v), binop);
 }
 
 
@@ -299,6 +1110,7 @@ Edge PSim::all2one_reduce_E(int destination, Edge value, std::function<Edge(Edge
  *  the functor 'binop'. The result is broadcast to every process from process 0.
  */
 int PSim::all2all_reduce(int value, std::function<int(int, int)>& binop) {
+    CallTimer ct(this->prof, "all2all_reduce");
     int reduction = all2one_reduce(0, value, binop);
     int all_reduction = one2all_broadcast(0, reduction);
     return all_reduction;
@@ -309,17 +1121,30 @@ int PSim::all2all_reduce(int value, std::function<int(int, int)>& binop) {
  *  All to all reduction returning the reduction of each process's Edge weighting using
  *  the functor 'binop'. The result is broadcast to every process from process 0.
  */
-Edge PSim::all2all_reduce_E(Edge value, std::function<Edge(Edge, Edge)>& binop) {
+Edge PSim::all2all_reduce_E(const Edge& value, std::function<Edge(const Edge&, const Edge&)>& binop) {
     Edge reduction = all2one_reduce_E(0, value, binop);
     Edge all_reduction = one2all_broadcast_E(0, reduction);
     return all_reduction;
 }
 
 
+/*
+ *  All to all reduction of each process's packed EdgeKey using the functor 'binop'.
+ *  The result is broadcast to every process from process 0.
+ */
+EdgeKey PSim::all2all_reduce_K(EdgeKey value, std::function<EdgeKey(EdgeKey, EdgeKey)>& binop) {
+    CallTimer ct(this->prof, "all2all_reduce_K");
+    EdgeKey reduction = all2one_reduce_K(0, value, binop);
+    EdgeKey all_reduction = one2all_broadcast_K(0, reduction);
+    return all_reduction;
+}
+
+
 /*
  *  Barrier
  */
 void PSim::barrier() {
+    CallTimer ct(this->prof, "barrier");
     all2all_broadcast(0);
 }
 
@@ -15,6 +15,7 @@
 #include <unistd.h>
 #include <math.h>
 #include <vector>
+#include <string>
 #include <iterator>
 #include <numeric>
 #include <boost/archive/text_iarchive.hpp>
@@ -23,6 +24,9 @@
 #include <boost/iostreams/device/file_descriptor.hpp>
 #include <boost/iostreams/stream.hpp>
 #include "primsAlgorithm.h"
+#include "psimProfiler.h"
+#include "psimPlacement.h"
+#include "psimCodec.h"
 
 //------------------------------------------------------------------------------------------------
 
@@ -75,8 +79,14 @@ static std::function<int(int, int)> min = [](int a, int b) { return ((a > b) ? b
 
 //Binop for comparing Edge objects against each other by weight: (Edge, Edge) => Edge
 
-static std::function<Edge(Edge, Edge)> edgemin = [](Edge a, Edge b) {return ((a.weight > b.weight) ? b : a); };
-static std::function<Edge(Edge, Edge)> edgemax = [](Edge a, Edge b) {return ((a.weight > b.weight) ? a : b); };
+static std::function<Edge(const Edge&, const Edge&)> edgemin = [](const Edge& a, const Edge& b) {return ((a.weight > b.weight) ? b : a); };
+static std::function<Edge(const Edge&, const Edge&)> edgemax = [](const Edge& a, const Edge& b) {return ((a.weight > b.weight) ? a : b); };
+
+//Binop for packed edges: (EdgeKey, EdgeKey) => EdgeKey. Keys order by weight, then endpoints.
+//keymin treats EDGE_KEY_NONE as "no edge"; keymax expects every process to hold a real edge.
+
+static std::function<EdgeKey(EdgeKey, EdgeKey)> keymin = [](EdgeKey a, EdgeKey b) { return ((a > b) ? b : a); };
+static std::function<EdgeKey(EdgeKey, EdgeKey)> keymax = [](EdgeKey a, EdgeKey b) { return ((a > b) ? a : b); };
 
 //------------------------------------------------------------------------------------------------
 
@@ -88,30 +98,86 @@ struct pipeFD {
     int fd[2];
 };
 
+/*
+ *  A fixed set of processes that PSim sessions can be carved out of: this process's
+ *  rank and its channel to every rank (outFd[j] / inFd[j], the same socket for
+ *  socket transports). Sessions never fork or open anything themselves.
+ */
+struct RankGroup {
+    int nprocs;
+    int rank;
+    std::vector<int> outFd;     //outFd[j]: write end of the channel to rank j
+    std::vector<int> inFd;      //inFd[j]: read end of the channel from rank j
+    Placement placement;
+    std::vector<int> cpuOf;
+    std::string transport;      //"pipe", "tcp" or "unix"
+};
+
+
+/*
+ *  A set of p processes forked once and reused by many PSim sessions. Every rank runs
+ *  the code that follows the constructor (SPMD), creates the same sessions in the
+ *  same order, and leaves through the destructor: workers exit there and rank 0
+ *  returns once all of them have.
+ */
+class RankPool : public RankGroup {
+public:
+    
+    RankPool(int p, const Placement& place = Placement::from_env());
+    ~RankPool();
+    
+    pipeFD **pipe_arr;
+    
+private:
+    std::vector<pid_t> children;
+};
+
+
 class PSim {
 public:
     
-    PSim(int p, std::function<bool(int, int, int)>& topo);
+    PSim(int p, std::function<bool(int, int, int)>& topo, const Placement& place = Placement::from_env());
+    PSim(RankGroup& group, std::function<bool(int, int, int)>& topo);
+    PSim(RankGroup& group, const std::vector<int>& members, std::function<bool(int, int, int)>& topo);
+    PSim(PSim& parent, const std::vector<int>& members, std::function<bool(int, int, int)>& topo);
     ~PSim();
     
+    void profile(const std::string& prefix, bool timeline = false);
+    void placement_report(std::ostream& os) const;
+    
+    void _write_frame(int j, const std::string& payload);
+    std::string _read_frame(int j);
+    
     void _send(int j, int data);
-    void _send_vector(int j, std::vector<int> data);
-    void _send_Edge(int j, Edge data);
+    void _send_vector(int j, const std::vector<int>& data);
+    void _send_vector(int j, std::vector<int>&& data);
+    void _send_bulk(int j, const std::vector<int>& data, std::vector<int>* owned);
+    void _send_Edge(int j, const Edge& data);
+    void _send_key(int j, EdgeKey data);
     void send(int j, int data);
     int _recv(int j);
     std::vector<int> _recv_vector(int j);
+    void _recv_vector_into(int j, std::vector<int>& out);
+    void _read_bulk(int j, size_t n, bool swapped, std::vector<int>& out);
     Edge _recv_Edge(int j);
+    EdgeKey _recv_key(int j);
     int recv(int j);
+    std::pair<int, int> recv_any();
+    std::pair<int, int> recv_any(const std::vector<int>& sources);
     
     int one2all_broadcast(int source, int value);
-    Edge one2all_broadcast_E(int source, Edge value);
+    Edge one2all_broadcast_E(int source, const Edge& value);
+    EdgeKey one2all_broadcast_K(int source, EdgeKey value);
     std::vector<int> all2all_broadcast(int value);
     std::vector<int> one2all_scatter(int source, std::vector<int> data);
+    std::vector<std::string> all2all_personalized(std::vector<std::string> parts);
     std::vector<int> all2one_collect(int destination, int data);
     int all2one_reduce(int destination, int value, std::function<int(int, int)>& binop);
-    Edge all2one_reduce_E(int destination, Edge value, std::function<Edge(Edge, Edge)>& binop);
+    Edge all2one_reduce_E(int destination, const Edge& value, std::function<Edge(const Edge&, const Edge&)>& binop);
+    EdgeKey all2one_reduce_K(int destination, EdgeKey value, std::function<EdgeKey(EdgeKey, EdgeKey)>& binop);
     int all2all_reduce(int value, std::function<int(int, int)>& binop);
-    Edge all2all_reduce_E(Edge value, std::function<Edge(Edge, Edge)>& binop);
+    Edge all2all_reduce_E(const Edge& value, std::function<Edge(const Edge&, const Edge&)>& binop);
+    EdgeKey all2all_reduce_K(EdgeKey value, std::function<EdgeKey(EdgeKey, EdgeKey)>& binop);
     void barrier();
     
     
@@ -121,7 +187,25 @@ public:
     int nprocs;
     std::function<bool(int, int, int)> topology; //hold the lambda functor for this network's topology
     int rank;
-    pipeFD **pipe_arr;
+    pipeFD **pipe_arr;          //owned p x p pipe matrix (nullptr for pool/sub-sessions)
+    std::vector<int> outFd;     //outFd[j]: write end of the channel to rank j
+    std::vector<int> inFd;      //inFd[j]: read end of the channel from rank j
+    std::vector<int> members;   //members[j]: rank j's rank in the parent pool/session
+    std::vector<int> groupOf;   //groupOf[j]: rank j's rank in the pool that owns the channels
+    Profiler prof;      //per-rank communication counters; off unless enabled
+    CodecPolicy codec;  //how large vectors are encoded (see psimCodec.h)
+    int epollFd;        //epoll set for arrival-order receives (-1 until first used)
+    Placement placement;
+    std::vector<int> cpuOf;     //CPU each rank is pinned to (-1 = unpinned)
+    
+private:
+    void attach(const std::vector<int>& parentOut, const std::vector<int>& parentIn, int parentRank,
+                const std::vector<int>& parentCpus, const Placement& parentPlacement,
+                const std::vector<int>& parentGroupOf);
+    void send_vector(int j, const std::vector<int>& data, std::vector<int>* owned);
+    
+    bool owner;                 //this session forked its ranks and must join them
+    std::vector<pid_t> children;
 };
 
 
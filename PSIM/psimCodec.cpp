@@ -0,0 +1,385 @@
+//
+//  psimCodec.cpp
+//  PSIM
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "psimCodec.h"
+
+static const unsigned char CODEC_MAGIC = 0xC0;
+static const unsigned char BULK_MAGIC = 0xB0;
+static const size_t HEADER_BYTES = 5;
+
+CodecPolicy::CodecPolicy() {
+    enabled = true;
+    forced = -1;
+    threshold = 64;
+    bulkBytes = 256 << 10;
+}
+
+CodecPolicy CodecPolicy::from_env() {
+    CodecPolicy policy;
+    const char* env = getenv("PSIM_CODEC");
+    if(env != NULL) {
+        std::string name = env;
+        if(name == "off")           policy.enabled = false;
+        else if(name == "raw")      policy.forced = CODEC_RAW;
+        else if(name == "delta")    policy.forced = CODEC_DELTA_VARINT;
+        else if(name == "for")      policy.forced = CODEC_FOR;
+        else if(name == "rle")      policy.forced = CODEC_RLE;
+        else if(name != "auto") {
+            std::cerr << "PSim: ignoring bad PSIM_CODEC=" << env << std::endl;
+        }
+    }
+    env = getenv("PSIM_CODEC_THRESHOLD");
+    if(env != NULL) {
+        policy.threshold = static_cast<size_t>(atol(env));
+    }
+    env = getenv("PSIM_BULK_THRESHOLD");
+    if(env != NULL) {
+        policy.bulkBytes = static_cast<size_t>(atol(env));
+    }
+    return policy;
+}
+
+VectorCodec CodecPolicy::choose(const std::vector<int>& data) const {
+    if(forced >= 0) {
+        return static_cast<VectorCodec>(forced);
+    }
+    return data.empty() ? CODEC_RAW : smallest_codec(&data[0], data.size());
+}
+
+//------------------------------------------------------------------------------------------------
+
+static inline uint32_t zigzag(uint32_t x) {
+    return (x << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(x) >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t z) {
+    return (z >> 1) ^ (0u - (z & 1));
+}
+
+static inline size_t varint_len(uint32_t v) {
+    return 1 + (v >= (1u << 7)) + (v >= (1u << 14)) + (v >= (1u << 21)) + (v >= (1u << 28));
+}
+
+static inline int bit_width(uint32_t v) {
+    int w = 0;
+    while(v != 0) {
+        w++;
+        v >>= 1;
+    }
+    return w;
+}
+
+static inline void put_le32(std::string& out, uint32_t v) {
+    out.push_back(static_cast<char>(v));
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v >> 16));
+    out.push_back(static_cast<char>(v >> 24));
+}
+
+static inline void store_le32(unsigned char* p, uint32_t v) {
+    p[0] = static_cast<unsigned char>(v);
+    p[1] = static_cast<unsigned char>(v >> 8);
+    p[2] = static_cast<unsigned char>(v >> 16);
+    p[3] = static_cast<unsigned char>(v >> 24);
+}
+
+static inline uint32_t load_le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static inline void put_varint(std::string& out, uint32_t v) {
+    while(v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+static inline bool get_varint(const unsigned char*& p, const unsigned char* end, uint32_t& v) {
+    v = 0;
+    for(int shift = 0; shift < 35 && p < end; shift += 7) {
+        unsigned char b = *p++;
+        v |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if((b & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ *  Encoded size of every codec in one pass: the varint bytes of the zigzag deltas,
+ *  the runs, and the range that sets the frame-of-reference width.
+ */
+static void measure(const int* data, size_t n, size_t bytes[CODEC_NCODECS]) {
+    size_t deltaBytes = 0, rleBytes = 0, runLen = 0;
+    uint32_t prev = 0;
+    int lo = (n > 0) ? data[0] : 0, hi = lo;
+    for(size_t i = 0; i < n; i++) {
+        uint32_t v = static_cast<uint32_t>(data[i]);
+        deltaBytes += varint_len(zigzag(v - prev));
+        if(i > 0 && data[i] != data[i-1]) {
+            rleBytes += varint_len(zigzag(prev)) + varint_len(static_cast<uint32_t>(runLen));
+            runLen = 0;
+        }
+        runLen++;
+        prev = v;
+        lo = (data[i] < lo) ? data[i] : lo;
+        hi = (data[i] > hi) ? data[i] : hi;
+    }
+    if(n > 0) {
+        rleBytes += varint_len(zigzag(prev)) + varint_len(static_cast<uint32_t>(runLen));
+    }
+    int width = bit_width(static_cast<uint32_t>(hi) - static_cast<uint32_t>(lo));
+    bytes[CODEC_RAW] = HEADER_BYTES + 4 * n;
+    bytes[CODEC_DELTA_VARINT] = HEADER_BYTES + deltaBytes;
+    bytes[CODEC_FOR] = HEADER_BYTES + 5 + ((n + 31) / 32) * 4 * width;
+    bytes[CODEC_RLE] = HEADER_BYTES + rleBytes;
+}
+
+//The codec with the smallest frame; on a tie the one that decodes fastest
+VectorCodec smallest_codec(const int* data, size_t n) {
+    size_t bytes[CODEC_NCODECS];
+    measure(data, n, bytes);
+    const VectorCodec bySpeed[] = {CODEC_RAW, CODEC_FOR, CODEC_RLE, CODEC_DELTA_VARINT};
+    VectorCodec best = CODEC_RAW;
+    for(int i = 1; i < CODEC_NCODECS; i++) {
+        if(bytes[bySpeed[i]] < bytes[best]) {
+            best = bySpeed[i];
+        }
+    }
+    return best;
+}
+
+size_t encoded_size(VectorCodec codec, const int* data, size_t n) {
+    size_t bytes[CODEC_NCODECS];
+    measure(data, n, bytes);
+    return bytes[codec];
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Frame of reference blocks: 32 offsets of 'w' bits packed into exactly w 32-bit
+ *  words, value i starting at bit i*w
+ */
+static void pack32(const uint32_t* in, int w, uint32_t* words) {
+    memset(words, 0, sizeof(uint32_t) * w);
+    for(int i = 0; i < 32 && w > 0; i++) {
+        int bit = i * w, word = bit >> 5, shift = bit & 31;
+        words[word] |= in[i] << shift;
+        if(shift + w > 32) {
+            words[word + 1] |= in[i] >> (32 - shift);
+        }
+    }
+}
+
+/*
+ *  Unpacking with the width as a template parameter turns every shift and mask into a
+ *  constant, so the compiler unrolls the block into straight-line shifts and ORs that
+ *  it can vectorize; decode_vector() picks the instance for the frame's width.
+ */
+template<int W>
+static void unpack32(const uint32_t* words, uint32_t* out) {
+    const uint32_t mask = static_cast<uint32_t>((1ULL << W) - 1);
+    for(int i = 0; i < 32; i++) {
+        const int bit = i * W, word = bit >> 5, shift = bit & 31;
+        uint32_t v = words[word] >> shift;
+        if(shift + W > 32) {
+            v |= words[word + 1] << (32 - shift);
+        }
+        out[i] = v & mask;
+    }
+}
+
+template<>
+void unpack32<0>(const uint32_t* /*words*/, uint32_t* out) {
+    memset(out, 0, sizeof(uint32_t) * 32);
+}
+
+typedef void (*Unpack32)(const uint32_t*, uint32_t*);
+
+static const Unpack32 UNPACK32[33] = {
+    unpack32<0>,  unpack32<1>,  unpack32<2>,  unpack32<3>,  unpack32<4>,  unpack32<5>,  unpack32<6>,
+    unpack32<7>,  unpack32<8>,  unpack32<9>,  unpack32<10>, unpack32<11>, unpack32<12>, unpack32<13>,
+    unpack32<14>, unpack32<15>, unpack32<16>, unpack32<17>, unpack32<18>, unpack32<19>, unpack32<20>,
+    unpack32<21>, unpack32<22>, unpack32<23>, unpack32<24>, unpack32<25>, unpack32<26>, unpack32<27>,
+    unpack32<28>, unpack32<29>, unpack32<30>, unpack32<31>, unpack32<32>
+};
+
+//------------------------------------------------------------------------------------------------
+
+//Append the frame for 'data' in 'codec' to 'out'
+void encode_vector(const std::vector<int>& data, VectorCodec codec, std::string& out) {
+    size_t n = data.size();
+    out.push_back(static_cast<char>(CODEC_MAGIC | codec));
+    put_le32(out, static_cast<uint32_t>(n));
+
+    if(codec == CODEC_RAW) {
+        size_t base = out.size();
+        out.resize(base + 4 * n);
+        unsigned char* p = reinterpret_cast<unsigned char*>(&out[base]);
+        for(size_t i = 0; i < n; i++) {
+            store_le32(p + 4 * i, static_cast<uint32_t>(data[i]));
+        }
+    }
+    else if(codec == CODEC_DELTA_VARINT) {
+        uint32_t prev = 0;
+        for(size_t i = 0; i < n; i++) {
+            uint32_t v = static_cast<uint32_t>(data[i]);
+            put_varint(out, zigzag(v - prev));
+            prev = v;
+        }
+    }
+    else if(codec == CODEC_FOR) {
+        int lo = 0, hi = 0;
+        for(size_t i = 0; i < n; i++) {
+            lo = (i == 0 || data[i] < lo) ? data[i] : lo;
+            hi = (i == 0 || data[i] > hi) ? data[i] : hi;
+        }
+        int w = bit_width(static_cast<uint32_t>(hi) - static_cast<uint32_t>(lo));
+        put_le32(out, static_cast<uint32_t>(lo));
+        out.push_back(static_cast<char>(w));
+        uint32_t block[32], words[32];
+        for(size_t b = 0; b < n; b += 32) {
+            for(size_t i = 0; i < 32; i++) {
+                block[i] = (b + i < n) ? static_cast<uint32_t>(data[b + i]) - static_cast<uint32_t>(lo) : 0;
+            }
+            pack32(block, w, words);
+            for(int i = 0; i < w; i++) {
+                put_le32(out, words[i]);
+            }
+        }
+    }
+    else if(codec == CODEC_RLE) {
+        for(size_t i = 0; i < n; ) {
+            size_t run = 1;
+            while(i + run < n && data[i + run] == data[i]) {
+                run++;
+            }
+            put_varint(out, zigzag(static_cast<uint32_t>(data[i])));
+            put_varint(out, static_cast<uint32_t>(run));
+            i += run;
+        }
+    }
+}
+
+bool is_encoded_frame(const std::string& frame) {
+    return frame.size() >= HEADER_BYTES && (static_cast<unsigned char>(frame[0]) & 0xF0) == CODEC_MAGIC &&
+           (static_cast<unsigned char>(frame[0]) & 0x0F) < CODEC_NCODECS;
+}
+
+/*
+ *  Decode a frame built by encode_vector into 'out'. Returns false (with 'out'
+ *  empty) when the frame is malformed.
+ */
+bool decode_vector(const std::string& frame, std::vector<int>& out) {
+    out.clear();
+    if(!is_encoded_frame(frame)) {
+        return false;
+    }
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(frame.data());
+    const unsigned char* end = p + frame.size();
+    VectorCodec codec = static_cast<VectorCodec>(p[0] & 0x0F);
+    size_t n = load_le32(p + 1);
+    p += HEADER_BYTES;
+
+    bool ok = true;
+    if(codec == CODEC_RAW) {
+        ok = static_cast<size_t>(end - p) == 4 * n;
+        if(ok) {
+            out.resize(n);
+            for(size_t i = 0; i < n; i++) {
+                out[i] = static_cast<int>(load_le32(p + 4 * i));
+            }
+        }
+    }
+    else if(codec == CODEC_DELTA_VARINT) {
+        //varints first, then the prefix sum in a separate tight loop
+        ok = static_cast<size_t>(end - p) >= n;
+        std::vector<uint32_t> z(ok ? n : 0);
+        for(size_t i = 0; i < z.size() && ok; i++) {
+            ok = get_varint(p, end, z[i]);
+        }
+        if(ok) {
+            out.resize(n);
+            uint32_t prev = 0;
+            for(size_t i = 0; i < n; i++) {
+                prev += unzigzag(z[i]);
+                out[i] = static_cast<int>(prev);
+            }
+        }
+    }
+    else if(codec == CODEC_FOR) {
+        int w = (end - p >= 5) ? p[4] : 33;
+        ok = w <= 32 && static_cast<size_t>(end - p) == 5 + ((n + 31) / 32) * 4 * static_cast<size_t>(w);
+        if(ok) {
+            uint32_t lo = load_le32(p);
+            p += 5;
+            out.resize(n);
+            Unpack32 unpack = UNPACK32[w];
+            uint32_t words[32], block[32];
+            for(size_t b = 0; b < n; b += 32) {
+                for(int i = 0; i < w; i++) {
+                    words[i] = load_le32(p + 4 * i);
+                }
+                p += 4 * w;
+                unpack(words, block);
+                size_t count = (n - b < 32) ? n - b : 32;
+                for(size_t i = 0; i < count; i++) {
+                    out[b + i] = static_cast<int>(block[i] + lo);
+                }
+            }
+        }
+    }
+    else if(codec == CODEC_RLE) {
+        out.reserve(n);
+        while(ok && p < end) {
+            uint32_t value, run;
+            ok = get_varint(p, end, value) && get_varint(p, end, run) && run <= n - out.size();
+            if(ok) {
+                out.insert(out.end(), run, static_cast<int>(unzigzag(value)));
+            }
+        }
+        ok = ok && out.size() == n;
+    }
+    if(!ok) {
+        std::cerr << "PSim: malformed " << CODEC_NAMES[codec] << " frame (" << frame.size() << " bytes)" << std::endl;
+        out.clear();
+    }
+    return ok;
+}
+
+//------------------------------------------------------------------------------------------------
+
+static bool host_is_little_endian() {
+    const uint32_t one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+//Announces n host-order ints that follow the frame on the same channel
+std::string bulk_header(size_t n) {
+    std::string frame;
+    frame.push_back(static_cast<char>(BULK_MAGIC));
+    frame.push_back(host_is_little_endian() ? 1 : 0);
+    put_le32(frame, static_cast<uint32_t>(n));
+    put_le32(frame, static_cast<uint32_t>(static_cast<uint64_t>(n) >> 32));
+    return frame;
+}
+
+//'swapped' is set when the sender's byte order differs from this host's
+bool is_bulk_header(const std::string& frame, size_t& n, bool& swapped) {
+    if(frame.size() != 10 || static_cast<unsigned char>(frame[0]) != BULK_MAGIC) {
+        return false;
+    }
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(frame.data());
+    n = static_cast<size_t>(load_le32(p + 2) | (static_cast<uint64_t>(load_le32(p + 6)) << 32));
+    swapped = (p[1] != 0) != host_is_little_endian();
+    return true;
+}
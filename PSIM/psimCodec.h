@@ -0,0 +1,75 @@
+//
+//  psimCodec.h
+//  PSIM
+//
+//  Integer vector codecs for PSim messages. Vectors of at least 'threshold' ints are
+//  sent as a binary frame instead of a Boost text archive:
+//
+//      byte 0      0xC0 | codec
+//      bytes 1-4   element count (little-endian)
+//      payload     codec specific, little-endian throughout
+//
+//  CODEC_RAW:           the ints themselves
+//  CODEC_DELTA_VARINT:  zigzag differences of consecutive ints as LEB128 varints
+//                       (sorted ids, offsets)
+//  CODEC_FOR:           frame of reference: the minimum, then every offset from it
+//                       bit-packed at one width in blocks of 32 (small counts, labels)
+//  CODEC_RLE:           (zigzag value, run length) varint pairs (flags, repeated values)
+//
+//  Vectors of at least bulkBytes bytes skip serialization altogether (see
+//  PSim::_send_vector): a small bulk header frame (0xB0, a byte-order flag, the
+//  element count) is followed on the channel by the ints in host byte order,
+//  vmspliced straight from the sender's vector where the channel is a pipe.
+//
+//  By default the codec is picked per message by computing the encoded size of each
+//  in one pass over the data. PSIM_CODEC=off|auto|raw|delta|for|rle and
+//  PSIM_CODEC_THRESHOLD=<ints> override this, and PSIM_BULK_THRESHOLD=<bytes> sets
+//  bulkBytes (0 disables bulk transfers). The receiver tells the frames apart by
+//  their first byte, so ranks may use different settings.
+//
+
+#ifndef __PSIM__psimCodec__
+#define __PSIM__psimCodec__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+enum VectorCodec {
+    CODEC_RAW,
+    CODEC_DELTA_VARINT,
+    CODEC_FOR,
+    CODEC_RLE,
+    CODEC_NCODECS
+};
+
+static const char* const CODEC_NAMES[CODEC_NCODECS] = {"raw", "delta_varint", "for", "rle"};
+
+
+struct CodecPolicy {
+    bool enabled;
+    int forced;             //a VectorCodec, or -1 to choose per message
+    size_t threshold;       //smallest vector (in ints) that is encoded
+    size_t bulkBytes;       //smallest vector (in bytes) sent as a bulk transfer
+
+    CodecPolicy();
+    static CodecPolicy from_env();
+
+    bool applies(size_t n) const { return enabled && n >= threshold; }
+    bool bulk(size_t n) const { return bulkBytes > 0 && n * sizeof(int) >= bulkBytes; }
+    VectorCodec choose(const std::vector<int>& data) const;
+};
+
+
+VectorCodec smallest_codec(const int* data, size_t n);
+size_t encoded_size(VectorCodec codec, const int* data, size_t n);
+void encode_vector(const std::vector<int>& data, VectorCodec codec, std::string& out);
+bool is_encoded_frame(const std::string& frame);
+bool decode_vector(const std::string& frame, std::vector<int>& out);
+
+std::string bulk_header(size_t n);
+bool is_bulk_header(const std::string& frame, size_t& n, bool& swapped);
+
+#endif /* defined(__PSIM__psimCodec__) */
@@ -0,0 +1,79 @@
+//
+//  psimKernels.cpp
+//  PSIM
+//
+
+#include "psimKernels.h"
+
+/*
+ *  Every rank's 'frame' at 'root', in rank order (empty elsewhere). The root's own
+ *  frame never goes through its pipe.
+ */
+std::vector<std::string> gather_frames(PSim& comm, int root, std::string frame) {
+    std::vector<std::string> frames;
+    if(comm.rank != root) {
+        comm._write_frame(root, frame);
+        return frames;
+    }
+    frames.resize(comm.nprocs);
+    frames[root].swap(frame);
+    for(int j = 0; j < comm.nprocs; j++) {
+        if(j != root) {
+            frames[j] = comm._read_frame(j);
+        }
+    }
+    return frames;
+}
+
+//The root's 'frame' on every rank
+std::string broadcast_frame(PSim& comm, int root, const std::string& frame) {
+    if(comm.rank != root) {
+        return comm._read_frame(root);
+    }
+    for(int j = 0; j < comm.nprocs; j++) {
+        if(j != root) {
+            comm._write_frame(j, frame);
+        }
+    }
+    return frame;
+}
+
+/*
+ *  Collective. Element-wise sum of every rank's 'local' counts (all the same length),
+ *  returned on every rank. Rank j owns bins [j*n/p, (j+1)*n/p): every rank sends it
+ *  that block of its counts, rank j adds them up, and the reduced blocks are then
+ *  all-gathered. Each rank moves about 2n counts however many ranks there are.
+ */
+std::vector<long long> sum_counts(PSim& comm, const std::vector<long long>& local) {
+    CallTimer ct(comm.prof, "sum_counts");
+    int p = comm.nprocs;
+    size_t n = local.size();
+    std::vector<size_t> first(p + 1);
+    for(int j = 0; j <= p; j++) {
+        first[j] = n * j / p;
+    }
+
+    std::vector<std::string> parts(p);
+    for(int j = 0; j < p; j++) {
+        parts[j] = pack_frame(local.data() + first[j], first[j+1] - first[j]);
+    }
+    std::vector<std::string> blocks = comm.all2all_personalized(std::move(parts));
+    std::vector<long long> mine(first[comm.rank + 1] - first[comm.rank], 0);
+    for(int j = 0; j < p; j++) {
+        std::vector<long long> block;
+        unpack_frame(blocks[j], block);
+        for(size_t i = 0; i < block.size() && i < mine.size(); i++) {
+            mine[i] += block[i];
+        }
+    }
+
+    std::string reduced = pack_frame(mine.data(), mine.size());
+    std::vector<std::string> copies(p, reduced);
+    blocks = comm.all2all_personalized(std::move(copies));
+    std::vector<long long> total;
+    total.reserve(n);
+    for(int j = 0; j < p; j++) {
+        unpack_frame(blocks[j], total);
+    }
+    return total;
+}
@@ -0,0 +1,175 @@
+//
+//  psimKernels.h
+//  PSIM
+//
+//  Reference kernels built on PSim's collectives, for workloads beyond MST and as
+//  stress tests of the collectives at realistic sizes:
+//
+//  sample_sort     sorts a distributed std::vector<T>: every rank sorts its partition,
+//                  rank 0 picks p-1 splitters from regular samples of all partitions
+//                  and broadcasts them, buckets are exchanged with a personalized
+//                  all-to-all and each rank merges the sorted runs it received. On
+//                  return rank r holds the r-th slice of the global order.
+//  histogram       counts a distributed std::vector<T> into bins; every rank returns
+//                  the global counts (reduce-scatter of the local counts, then an
+//                  all-gather of the reduced blocks)
+//
+//  T must be trivially copyable: partitions travel as raw byte frames, so every rank
+//  must share a byte order.
+//
+
+#ifndef __PSIM__psimKernels__
+#define __PSIM__psimKernels__
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "psim.h"
+
+
+//n values of T as a byte frame, and back (appended to 'out')
+template<typename T>
+std::string pack_frame(const T* data, size_t n) {
+    return std::string(reinterpret_cast<const char*>(data), n * sizeof(T));
+}
+
+template<typename T>
+void unpack_frame(const std::string& frame, std::vector<T>& out) {
+    size_t n = frame.size() / sizeof(T);
+    size_t at = out.size();
+    out.resize(at + n);
+    if(n > 0) {
+        memcpy(&out[at], frame.data(), n * sizeof(T));
+    }
+}
+
+std::vector<std::string> gather_frames(PSim& comm, int root, std::string frame);
+std::string broadcast_frame(PSim& comm, int root, const std::string& frame);
+std::vector<long long> sum_counts(PSim& comm, const std::vector<long long>& local);
+
+
+/*
+ *  Merge the sorted runs [bounds[i], bounds[i+1]) of 'v' in place, pairwise, in
+ *  log2(runs) passes
+ */
+template<typename T, typename Less>
+void merge_runs(std::vector<T>& v, std::vector<size_t> bounds, Less less) {
+    while(bounds.size() > 2) {
+        std::vector<size_t> next(1, 0);
+        for(size_t i = 0; i + 2 < bounds.size(); i += 2) {
+            std::inplace_merge(v.begin() + bounds[i], v.begin() + bounds[i+1], v.begin() + bounds[i+2], less);
+            next.push_back(bounds[i+2]);
+        }
+        if(bounds.size() % 2 == 0) {
+            next.push_back(bounds.back());    //odd number of runs: the last one waits a pass
+        }
+        bounds.swap(next);
+    }
+}
+
+/*
+ *  Collective. Sorts the union of every rank's 'data' by 'less'. 'oversample' keys per
+ *  rank are sampled for the splitters; more samples even out the buckets at the cost
+ *  of a larger gather at rank 0. Equal keys all land in one bucket, so heavily
+ *  repeated keys unbalance the result.
+ */
+template<typename T, typename Less = std::less<T>>
+std::vector<T> sample_sort(PSim& comm, std::vector<T> data, Less less = Less(), int oversample = 32) {
+    static_assert(std::is_trivially_copyable<T>::value, "sample_sort sends T as raw bytes");
+    CallTimer ct(comm.prof, "sample_sort");
+    int p = comm.nprocs;
+    {
+        CallTimer phase(comm.prof, "sort_local");
+        std::sort(data.begin(), data.end(), less);
+    }
+    if(p == 1) {
+        return data;
+    }
+
+    //regular samples of every sorted partition -> p-1 evenly spaced splitters
+    std::vector<T> splitters;
+    {
+        CallTimer phase(comm.prof, "sort_splitters");
+        std::vector<T> samples;
+        for(int i = 0; i < oversample && !data.empty(); i++) {
+            samples.push_back(data[(2 * (size_t)i + 1) * data.size() / (2 * (size_t)oversample)]);
+        }
+        std::vector<std::string> frames = gather_frames(comm, 0, pack_frame(samples.data(), samples.size()));
+        if(comm.rank == 0) {
+            samples.clear();
+            for(int j = 0; j < p; j++) {
+                unpack_frame(frames[j], samples);
+            }
+            std::sort(samples.begin(), samples.end(), less);
+            for(int k = 1; k < p && !samples.empty(); k++) {
+                splitters.push_back(samples[(size_t)k * samples.size() / p]);
+            }
+        }
+        std::string frame = broadcast_frame(comm, 0, pack_frame(splitters.data(), splitters.size()));
+        splitters.clear();
+        unpack_frame(frame, splitters);
+    }
+
+    //bucket j holds the keys after splitter j-1, up to and including splitter j
+    std::vector<std::string> parts(p);
+    size_t begin = 0;
+    for(int j = 0; j < p; j++) {
+        size_t end = data.size();
+        if(j < (int)splitters.size()) {
+            end = std::upper_bound(data.begin() + begin, data.end(), splitters[j], less) - data.begin();
+        }
+        parts[j] = pack_frame(data.data() + begin, end - begin);
+        begin = end;
+    }
+    std::vector<T>().swap(data);
+    std::vector<std::string> runs = comm.all2all_personalized(std::move(parts));
+
+    CallTimer phase(comm.prof, "sort_merge");
+    std::vector<size_t> bounds(1, 0);
+    size_t total = 0;
+    for(int j = 0; j < p; j++) {
+        total += runs[j].size() / sizeof(T);
+    }
+    data.reserve(total);
+    for(int j = 0; j < p; j++) {
+        unpack_frame(runs[j], data);
+        std::string().swap(runs[j]);
+        bounds.push_back(data.size());
+    }
+    merge_runs(data, bounds, less);
+    return data;
+}
+
+/*
+ *  Collective. Global counts of 'data' over 'bins' bins, where binOf(x) gives the bin
+ *  of x; values whose bin is outside [0, bins) are not counted. Every rank must pass
+ *  the same 'bins'.
+ */
+template<typename T, typename BinOf>
+std::vector<long long> histogram(PSim& comm, const std::vector<T>& data, int bins, BinOf binOf) {
+    CallTimer ct(comm.prof, "histogram");
+    std::vector<long long> counts(bins, 0);
+    for(size_t i = 0; i < data.size(); i++) {
+        int b = binOf(data[i]);
+        if(b >= 0 && b < bins) {
+            counts[b]++;
+        }
+    }
+    return sum_counts(comm, counts);
+}
+
+//'bins' equal-width bins over [lo, hi)
+template<typename T>
+std::vector<long long> histogram(PSim& comm, const std::vector<T>& data, T lo, T hi, int bins) {
+    double scale = bins / ((double)hi - (double)lo);
+    return histogram(comm, data, bins, [lo, scale, bins](const T& x) {
+        double at = ((double)x - (double)lo) * scale;
+        return (at < 0.0 || at >= bins) ? -1 : (int)at;
+    });
+}
+
+#endif /* defined(__PSIM__psimKernels__) */
@@ -0,0 +1,375 @@
+//
+//  psimPlacement.cpp
+//  PSIM
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <map>
+#include <deque>
+#include "psimPlacement.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT 0
+#endif
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4
+#endif
+#endif
+
+//Nodes covered by a saved memory policy's node mask (the kernel's largest MAX_NUMNODES)
+static const int POLICY_MAX_NODES = 1024;
+
+Placement::Placement(PlacementPolicy policyIn) {
+    this->policy = policyIn;
+    this->bindMemory = true;
+    this->policySaved = false;
+    this->savedPolicy = 0;
+}
+
+Placement::Placement(const std::vector<int>& cpusIn) {
+    this->policy = PLACE_EXPLICIT;
+    this->cpus = cpusIn;
+    this->bindMemory = true;
+    this->policySaved = false;
+    this->savedPolicy = 0;
+}
+
+/*
+ *  none | compact | scatter | topology | <cpu>,<cpu>,... (explicit)
+ */
+bool Placement::parse(const std::string& text) {
+    if(text.empty() || text == "none")  policy = PLACE_NONE;
+    else if(text == "compact")          policy = PLACE_COMPACT;
+    else if(text == "scatter")          policy = PLACE_SCATTER;
+    else if(text == "topology")         policy = PLACE_TOPOLOGY;
+    else {
+        std::vector<int> list;
+        std::stringstream ss(text);
+        std::string item;
+        while(std::getline(ss, item, ',')) {
+            char* end = NULL;
+            long cpu = strtol(item.c_str(), &end, 10);
+            if(item.empty() || *end != '\0' || cpu < 0) {
+                return false;
+            }
+            list.push_back(static_cast<int>(cpu));
+        }
+        policy = PLACE_EXPLICIT;
+        cpus = list;
+    }
+    return true;
+}
+
+Placement Placement::from_env() {
+    Placement placement;
+    const char* env = getenv("PSIM_PLACEMENT");
+    if(env != NULL && !placement.parse(env)) {
+        std::cerr << "PSim: ignoring bad PSIM_PLACEMENT=" << env << std::endl;
+        placement.policy = PLACE_NONE;
+    }
+    return placement;
+}
+
+std::string Placement::str() const {
+    const char* names[] = {"none", "compact", "scatter", "explicit", "topology"};
+    std::ostringstream os;
+    os << names[policy];
+    for(size_t i = 0; i < cpus.size() && policy == PLACE_EXPLICIT; i++) {
+        os << ((i == 0) ? ":" : ",") << cpus[i];
+    }
+    return os.str();
+}
+
+//------------------------------------------------------------------------------------------------
+
+#ifdef __linux__
+static int read_sys_int(const std::string& path, int fallback) {
+    std::ifstream in(path.c_str());
+    int value;
+    return (in >> value) ? value : fallback;
+}
+
+//The NUMA node of 'cpu' is given by the nodeN entry in its sysfs directory
+static int cpu_node(int cpu) {
+    std::ostringstream dir;
+    dir << "/sys/devices/system/cpu/cpu" << cpu;
+    DIR* d = opendir(dir.str().c_str());
+    int node = 0;
+    if(d != NULL) {
+        struct dirent* ent;
+        while((ent = readdir(d)) != NULL) {
+            if(strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+                node = atoi(ent->d_name + 4);
+                break;
+            }
+        }
+        closedir(d);
+    }
+    return node;
+}
+#endif
+
+/*
+ *  The CPUs in this process's affinity mask with their core, socket and NUMA node,
+ *  in CPU id order. With 'allOnline', every online CPU of the machine instead (a
+ *  pinned rank's mask holds only its own CPU). Empty where the topology cannot be read.
+ */
+std::vector<CpuInfo> read_cpu_topology(bool allOnline) {
+    std::vector<CpuInfo> out;
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if(allOnline) {
+        //a list of ids and ranges, e.g. "0-3,8-11"
+        std::ifstream in("/sys/devices/system/cpu/online");
+        std::string list, item;
+        std::getline(in, list);
+        std::istringstream items(list);
+        while(std::getline(items, item, ',')) {
+            int lo = 0, hi = -1;
+            char dash = 0;
+            std::istringstream range(item);
+            if(!(range >> lo)) {
+                continue;
+            }
+            hi = (range >> dash >> hi && dash == '-') ? hi : lo;
+            for(int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+                CPU_SET(cpu, &mask);
+            }
+        }
+    }
+    else if(sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+        return out;
+    }
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(!CPU_ISSET(cpu, &mask)) {
+            continue;
+        }
+        std::ostringstream base;
+        base << "/sys/devices/system/cpu/cpu" << cpu << "/topology/";
+        CpuInfo info;
+        info.cpu = cpu;
+        info.core = read_sys_int(base.str() + "core_id", cpu);
+        info.socket = read_sys_int(base.str() + "physical_package_id", 0);
+        info.node = cpu_node(cpu);
+        out.push_back(info);
+    }
+#endif
+    return out;
+}
+
+/*
+ *  CPUs grouped by socket. Within a socket the first hardware thread of every core
+ *  comes before any second thread, so ranks get whole cores before sharing one.
+ */
+static std::vector<std::vector<CpuInfo> > cpus_by_socket(const std::vector<CpuInfo>& topo) {
+    std::map<int, std::vector<CpuInfo> > sockets;
+    for(size_t i = 0; i < topo.size(); i++) {
+        sockets[topo[i].socket].push_back(topo[i]);
+    }
+    std::vector<std::vector<CpuInfo> > out;
+    for(std::map<int, std::vector<CpuInfo> >::iterator it = sockets.begin(); it != sockets.end(); it++) {
+        std::vector<CpuInfo>& list = it->second;
+        std::map<int, int> threadOf;    //core -> threads seen so far
+        std::vector<std::pair<std::pair<int, int>, CpuInfo> > keyed;
+        for(size_t i = 0; i < list.size(); i++) {
+            int thread = threadOf[list[i].core]++;
+            keyed.push_back(std::make_pair(std::make_pair(thread, list[i].core), list[i]));
+        }
+        std::stable_sort(keyed.begin(), keyed.end(),
+                         [](const std::pair<std::pair<int, int>, CpuInfo>& a, const std::pair<std::pair<int, int>, CpuInfo>& b) {
+                             return a.first < b.first;
+                         });
+        std::vector<CpuInfo> ordered;
+        for(size_t i = 0; i < keyed.size(); i++) {
+            ordered.push_back(keyed[i].second);
+        }
+        out.push_back(ordered);
+    }
+    return out;
+}
+
+/*
+ *  The CPU for every rank (-1 = not pinned). Ranks wrap around when there are more
+ *  ranks than CPUs.
+ */
+std::vector<int> Placement::map(int nprocs, const std::function<bool(int, int, int)>& topo) const {
+    std::vector<int> cpuOf(nprocs, -1);
+    if(policy == PLACE_NONE) {
+        return cpuOf;
+    }
+    if(policy == PLACE_EXPLICIT) {
+        for(int r = 0; r < nprocs && !cpus.empty(); r++) {
+            cpuOf[r] = cpus[r % cpus.size()];
+        }
+        return cpuOf;
+    }
+
+    std::vector<std::vector<CpuInfo> > sockets = cpus_by_socket(read_cpu_topology());
+    std::vector<int> compact;
+    for(size_t s = 0; s < sockets.size(); s++) {
+        for(size_t i = 0; i < sockets[s].size(); i++) {
+            compact.push_back(sockets[s][i].cpu);
+        }
+    }
+    if(compact.empty()) {
+        return cpuOf;
+    }
+
+    if(policy == PLACE_COMPACT) {
+        for(int r = 0; r < nprocs; r++) {
+            cpuOf[r] = compact[r % compact.size()];
+        }
+    }
+    else if(policy == PLACE_SCATTER) {
+        std::vector<int> dealt;
+        for(size_t i = 0; dealt.size() < compact.size(); i++) {
+            for(size_t s = 0; s < sockets.size(); s++) {
+                if(i < sockets[s].size()) {
+                    dealt.push_back(sockets[s][i].cpu);
+                }
+            }
+        }
+        for(int r = 0; r < nprocs; r++) {
+            cpuOf[r] = dealt[r % dealt.size()];
+        }
+    }
+    else if(policy == PLACE_TOPOLOGY) {
+        //Fill the sockets one at a time; each socket takes a breadth-first region of
+        //the rank graph grown from the lowest rank not yet placed
+        std::vector<char> placed(nprocs, 0);
+        int nPlaced = 0;
+        while(nPlaced < nprocs) {
+            for(size_t s = 0; s < sockets.size() && nPlaced < nprocs; s++) {
+                std::deque<int> frontier;
+                std::vector<char> queued(placed);
+                for(size_t slot = 0; slot < sockets[s].size() && nPlaced < nprocs; slot++) {
+                    if(frontier.empty()) {
+                        int seed = static_cast<int>(std::find(placed.begin(), placed.end(), 0) - placed.begin());
+                        for(int r = seed; r < nprocs; r++) {
+                            if(!queued[r]) {
+                                frontier.push_back(r);
+                                queued[r] = 1;
+                                break;
+                            }
+                        }
+                    }
+                    int r = frontier.front();
+                    frontier.pop_front();
+                    cpuOf[r] = sockets[s][slot].cpu;
+                    placed[r] = 1;
+                    nPlaced++;
+                    for(int j = 0; j < nprocs; j++) {
+                        if(!queued[j] && j != r && topo(r, j, nprocs)) {
+                            frontier.push_back(j);
+                            queued[j] = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return cpuOf;
+}
+
+/*
+ *  Pin the calling process to 'cpu' and, with bindMemory, make its allocations
+ *  node-local. Pages inherited from the parent stay where they are until the rank
+ *  writes them; the copy is then first-touched on the rank's own node. The previous
+ *  affinity mask and memory policy are kept so unpin() can restore them.
+ */
+bool Placement::pin(int cpu) {
+#ifdef __linux__
+    if(cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t old, mask;
+    if(sched_getaffinity(0, sizeof(old), &old) == 0) {
+        this->savedMask.assign(reinterpret_cast<char*>(&old), reinterpret_cast<char*>(&old) + sizeof(old));
+    }
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    if(sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+        perror("PSim sched_setaffinity");
+        return false;
+    }
+    if(this->bindMemory) {
+        //an inherited bind/interleave policy would otherwise override first touch
+        int mode = MPOL_DEFAULT;
+        std::vector<unsigned long> nodes(POLICY_MAX_NODES / (8 * sizeof(unsigned long)), 0);
+        this->policySaved = syscall(SYS_get_mempolicy, &mode, &nodes[0], POLICY_MAX_NODES, NULL, 0) == 0;
+        if(this->policySaved) {
+            this->savedPolicy = mode;
+            this->savedNodes.swap(nodes);
+        }
+        syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+//Restore the affinity mask and memory policy in effect before pin()
+void Placement::unpin() {
+#ifdef __linux__
+    if(savedMask.size() == sizeof(cpu_set_t)) {
+        sched_setaffinity(0, sizeof(cpu_set_t), reinterpret_cast<const cpu_set_t*>(&savedMask[0]));
+        this->savedMask.clear();
+    }
+    if(this->policySaved) {
+        //the mask of a default or local policy is empty, which set_mempolicy accepts
+        syscall(SYS_set_mempolicy, this->savedPolicy, &this->savedNodes[0], POLICY_MAX_NODES);
+        this->policySaved = false;
+    }
+#endif
+}
+
+/*
+ *  One line per rank: the CPU it is pinned to and that CPU's core, socket and node
+ */
+void Placement::report(std::ostream& os, const std::vector<int>& cpuOf) const {
+    //the caller is usually pinned already, so not its own mask: the whole machine
+    std::vector<CpuInfo> topo = read_cpu_topology(true);
+    std::map<int, CpuInfo> byCpu;
+    for(size_t i = 0; i < topo.size(); i++) {
+        byCpu[topo[i].cpu] = topo[i];
+    }
+    os << "placement " << this->str() << " (" << cpuOf.size() << " ranks)\n";
+    os << "rank   cpu  core  socket  node\n";
+    for(size_t r = 0; r < cpuOf.size(); r++) {
+        os << std::setw(4) << r;
+        if(cpuOf[r] < 0) {
+            os << "     -     -       -     -\n";
+            continue;
+        }
+        os << std::setw(6) << cpuOf[r];
+        std::map<int, CpuInfo>::iterator it = byCpu.find(cpuOf[r]);
+        if(it != byCpu.end()) {
+            os << std::setw(6) << it->second.core << std::setw(8) << it->second.socket << std::setw(6) << it->second.node;
+        }
+        os << "\n";
+    }
+    os.flush();
+}
+
+//The policy and the CPU of every rank on one line, e.g. "scatter=0,8,1,9" (for result files)
+std::string Placement::mapping_str(const std::vector<int>& cpuOf) const {
+    std::ostringstream os;
+    os << ((policy == PLACE_EXPLICIT) ? "explicit" : this->str());
+    for(size_t r = 0; r < cpuOf.size() && policy != PLACE_NONE; r++) {
+        os << ((r == 0) ? "=" : ",") << cpuOf[r];
+    }
+    return os.str();
+}
@@ -0,0 +1,76 @@
+//
+//  psimPlacement.h
+//  PSIM
+//
+//  CPU and NUMA placement of PSim ranks. The rank -> CPU map is computed once before
+//  the fork and every process pins itself right after it:
+//
+//  PLACE_NONE:      leave scheduling to the OS (default)
+//  PLACE_COMPACT:   fill one socket's cores before moving to the next
+//  PLACE_SCATTER:   deal ranks round-robin across sockets
+//  PLACE_EXPLICIT:  rank r runs on cpus[r % cpus.size()]
+//  PLACE_TOPOLOGY:  grow each socket's share of ranks breadth-first over the PSim
+//                   topology, so MESH2/TORUS2/TREE neighbours land on the same socket
+//
+//  The policy can also be chosen with PSIM_PLACEMENT=none|compact|scatter|topology or
+//  a comma separated CPU list. Pinning and memory binding use Linux interfaces
+//  (sched_setaffinity, set_mempolicy); elsewhere placement is a no-op.
+//
+
+#ifndef __PSIM__psimPlacement__
+#define __PSIM__psimPlacement__
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+
+
+enum PlacementPolicy {
+    PLACE_NONE,
+    PLACE_COMPACT,
+    PLACE_SCATTER,
+    PLACE_EXPLICIT,
+    PLACE_TOPOLOGY
+};
+
+//One logical CPU this process may run on, as described by /sys
+struct CpuInfo {
+    int cpu;
+    int core;       //core_id within the socket
+    int socket;     //physical_package_id
+    int node;       //NUMA node
+};
+
+
+class Placement {
+public:
+
+    Placement(PlacementPolicy policy = PLACE_NONE);
+    Placement(const std::vector<int>& cpus);
+
+    bool parse(const std::string& text);
+    static Placement from_env();
+    std::string str() const;
+
+    std::vector<int> map(int nprocs, const std::function<bool(int, int, int)>& topo) const;
+    bool pin(int cpu);
+    void unpin();
+    void report(std::ostream& os, const std::vector<int>& cpuOf) const;
+    std::string mapping_str(const std::vector<int>& cpuOf) const;
+
+    PlacementPolicy policy;
+    std::vector<int> cpus;      //PLACE_EXPLICIT core list
+    bool bindMemory;            //reset the rank's memory policy to node-local allocation
+
+private:
+    std::vector<char> savedMask;    //caller's affinity mask, restored by unpin()
+    bool policySaved;               //caller's memory policy (mode and node mask), likewise
+    int savedPolicy;
+    std::vector<unsigned long> savedNodes;
+};
+
+std::vector<CpuInfo> read_cpu_topology(bool allOnline = false);
+
+#endif /* defined(__PSIM__psimPlacement__) */
@@ -0,0 +1,331 @@
+//
+//  psimProfiler.cpp
+//  PSIM
+//
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <set>
+#include <unistd.h>
+#include "psimProfiler.h"
+
+//Sessions started by this process so far, per member list (in pool ranks). Every
+//member of a session creates the sessions over those members in the same order, and
+//forked ranks inherit the counts, so all members agree on a session's number.
+static std::map<std::vector<int>, int> g_sessions;
+
+//Prefixes whose stale files this process, or the one it was forked from, has removed
+static std::set<std::string> g_prepared;
+
+Profiler::Profiler() {
+    enabled = false;
+    timeline = false;
+    rank = 0;
+    nprocs = 0;
+    session = 0;
+    for(int i = 0; i < PROF_NPHASES; i++) {
+        phaseNs[i] = 0;
+    }
+}
+
+long long Profiler::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ *  Called by every rank once its PSim is set up, with the pool rank of each session
+ *  rank. Picks up PSIM_PROFILE/PSIM_TRACE.
+ */
+void Profiler::start(int rankIn, int nprocsIn, const std::vector<int>& groupOfIn) {
+    this->rank = rankIn;
+    this->nprocs = nprocsIn;
+    this->groupOf = groupOfIn;
+    this->session = g_sessions[groupOfIn]++;
+    const char* envPrefix = getenv("PSIM_PROFILE");
+    if(envPrefix != NULL && envPrefix[0] != '\0') {
+        const char* envTrace = getenv("PSIM_TRACE");
+        this->enable(envPrefix, envTrace != NULL && strcmp(envTrace, "0") != 0);
+    }
+}
+
+void Profiler::enable(const std::string& prefixIn, bool timelineIn) {
+    this->prefix = prefixIn;
+    this->timeline = timelineIn;
+    this->enabled = true;
+    msgsSent.assign(nprocs, 0);
+    bytesSent.assign(nprocs, 0);
+    msgsRecv.assign(nprocs, 0);
+    bytesRecv.assign(nprocs, 0);
+}
+
+void Profiler::add_phase(ProfPhase phase, long long t0) {
+    phaseNs[phase] += now_ns() - t0;
+}
+
+void Profiler::add_message(bool sent, int peer, size_t bytes, long long t0) {
+    if(sent) {
+        msgsSent[peer]++;
+        bytesSent[peer] += bytes;
+    }
+    else {
+        msgsRecv[peer]++;
+        bytesRecv[peer] += bytes;
+    }
+    if(timeline) {
+        Event ev = {sent ? "send" : "recv", t0, now_ns() - t0, peer, (long long)bytes, 0};
+        events.push_back(ev);
+    }
+}
+
+//Bytes that followed a message's frame on the channel (bulk transfers)
+void Profiler::add_payload(bool sent, int peer, size_t bytes) {
+    if(sent) {
+        bytesSent[peer] += bytes;
+    }
+    else {
+        bytesRecv[peer] += bytes;
+    }
+}
+
+void Profiler::add_call(const char* name, long long t0) {
+    long long dur = now_ns() - t0;
+    CallStats& cs = calls[name];
+    cs.calls++;
+    cs.ns += dur;
+    if(timeline) {
+        Event ev = {name, t0, dur, -1, 0, 0};
+        events.push_back(ev);
+    }
+}
+
+/*
+ *  One vector encoded for 'peer'. The timeline gets an event per message so the
+ *  compression ratio of individual messages can be inspected.
+ */
+void Profiler::add_codec(const char* codec, int peer, size_t rawBytes, size_t wireBytes, long long t0) {
+    long long dur = now_ns() - t0;
+    CodecStats& cs = codecs[codec];
+    cs.msgs++;
+    cs.rawBytes += rawBytes;
+    cs.wireBytes += wireBytes;
+    cs.ns += dur;
+    if(timeline) {
+        Event ev = {codec, t0, dur, peer, (long long)wireBytes, (long long)rawBytes};
+        events.push_back(ev);
+    }
+}
+
+/*
+ *  Called where a pool of ranks is created, before it forks (or by each rank of a
+ *  socket mesh for itself): removes <prefix>.<r>.prof for pool ranks [first,
+ *  first+count) left over from an earlier run. Only the first pool of a run does;
+ *  later pools append to the files of the earlier ones.
+ */
+void Profiler::prepare(int first, int count) {
+    const char* envPrefix = getenv("PSIM_PROFILE");
+    if(envPrefix == NULL || envPrefix[0] == '\0' || g_prepared.count(envPrefix) > 0) {
+        return;
+    }
+    for(int r = first; r < first + count; r++) {
+        std::ostringstream path;
+        path << envPrefix << "." << r << ".prof";
+        unlink(path.str().c_str());
+    }
+    g_prepared.insert(envPrefix);
+}
+
+/*
+ *  Append this session's counters and events to <prefix>.<pool rank>.prof, with peers
+ *  given as pool ranks. A prefix no pool prepared (PSim::profile) is truncated by the
+ *  first session of this process that dumps to it.
+ */
+void Profiler::dump() {
+    if(!enabled || rank < 0) {
+        return;
+    }
+    std::ostringstream path;
+    path << prefix << "." << groupOf[rank] << ".prof";
+    bool fresh = g_prepared.insert(prefix).second;
+    std::ofstream out(path.str().c_str(), fresh ? std::ios::trunc : std::ios::app);
+
+    out << "session " << session << " rank " << groupOf[rank] << " nprocs " << nprocs << " members";
+    for(int j = 0; j < nprocs; j++) {
+        out << (j == 0 ? " " : ",") << groupOf[j];
+    }
+    out << "\n";
+    for(int i = 0; i < PROF_NPHASES; i++) {
+        out << "phase " << PROF_PHASE_NAMES[i] << " " << phaseNs[i] << "\n";
+    }
+    for(int j = 0; j < nprocs; j++) {
+        out << "peer " << groupOf[j] << " " << msgsSent[j] << " " << bytesSent[j] << " "
+            << msgsRecv[j] << " " << bytesRecv[j] << "\n";
+    }
+    for(std::map<std::string, CallStats>::iterator it = calls.begin(); it != calls.end(); it++) {
+        out << "call " << it->first << " " << it->second.calls << " " << it->second.ns << "\n";
+    }
+    for(std::map<std::string, CodecStats>::iterator it = codecs.begin(); it != codecs.end(); it++) {
+        out << "codec " << it->first << " " << it->second.msgs << " " << it->second.rawBytes << " "
+            << it->second.wireBytes << " " << it->second.ns << "\n";
+    }
+    for(size_t i = 0; i < events.size(); i++) {
+        const Event& ev = events[i];
+        out << "event " << ev.name << " " << ev.ts << " " << ev.dur << " " << (ev.peer >= 0 ? groupOf[ev.peer] : -1) << " " << ev.bytes << " " << ev.raw << "\n";
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Merge <prefix>.0.prof .. <prefix>.<nprocs-1>.prof into one Chrome trace JSON file
+ *  (one trace process per rank) and print a per-rank / per-collective summary.
+ *  Returns the number of rank files that could not be read.
+ */
+int Profiler::merge(const std::string& prefix, int nprocs, const std::string& traceFile, std::ostream& summary) {
+    struct RankTotals {
+        long long phase[PROF_NPHASES];
+        long long msgsSent, bytesSent, msgsRecv, bytesRecv;
+        std::vector<long long> peerBytes;
+    };
+    struct MergedEvent {
+        std::string name;
+        long long ts, dur;
+        int rank, peer;
+        long long bytes, raw;
+    };
+
+    std::vector<RankTotals> totals(nprocs);
+    std::map<std::string, CallStats> allCalls;
+    std::map<std::string, CodecStats> allCodecs;
+    std::vector<MergedEvent> events;
+    long long t0 = -1;
+    int missing = 0;
+
+    for(int r = 0; r < nprocs; r++) {
+        RankTotals& rt = totals[r];
+        memset(rt.phase, 0, sizeof(rt.phase));
+        rt.msgsSent = rt.bytesSent = rt.msgsRecv = rt.bytesRecv = 0;
+        rt.peerBytes.assign(nprocs, 0);
+
+        std::ostringstream path;
+        path << prefix << "." << r << ".prof";
+        std::ifstream in(path.str().c_str());
+        if(!in) {
+            std::cerr << "trace-merge: missing " << path.str() << std::endl;
+            missing++;
+            continue;
+        }
+        std::string line;
+        while(std::getline(in, line)) {
+            std::istringstream ls(line);
+            std::string kind;
+            ls >> kind;
+            if(kind == "phase") {
+                std::string name;
+                long long ns;
+                ls >> name >> ns;
+                for(int i = 0; i < PROF_NPHASES; i++) {
+                    if(name == PROF_PHASE_NAMES[i]) rt.phase[i] += ns;
+                }
+            }
+            else if(kind == "peer") {
+                int j;
+                long long ms, bs, mr, br;
+                ls >> j >> ms >> bs >> mr >> br;
+                rt.msgsSent += ms;
+                rt.bytesSent += bs;
+                rt.msgsRecv += mr;
+                rt.bytesRecv += br;
+                if(j >= 0 && j < nprocs) rt.peerBytes[j] += bs;
+            }
+            else if(kind == "call") {
+                std::string name;
+                long long n, ns;
+                ls >> name >> n >> ns;
+                allCalls[name].calls += n;
+                allCalls[name].ns += ns;
+            }
+            else if(kind == "codec") {
+                std::string name;
+                CodecStats cs;
+                ls >> name >> cs.msgs >> cs.rawBytes >> cs.wireBytes >> cs.ns;
+                CodecStats& total = allCodecs[name];
+                total.msgs += cs.msgs;
+                total.rawBytes += cs.rawBytes;
+                total.wireBytes += cs.wireBytes;
+                total.ns += cs.ns;
+            }
+            else if(kind == "event") {
+                MergedEvent ev;
+                ev.raw = 0;
+                ls >> ev.name >> ev.ts >> ev.dur >> ev.peer >> ev.bytes >> ev.raw;
+                ev.rank = r;
+                if(t0 < 0 || ev.ts < t0) t0 = ev.ts;
+                events.push_back(ev);
+            }
+        }
+    }
+
+    //Chrome trace: complete ("X") events, timestamps in microseconds from the first event
+    std::ofstream trace(traceFile.c_str());
+    trace << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    for(int r = 0; r < nprocs; r++) {
+        trace << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << r
+              << ", \"args\": {\"name\": \"rank " << r << "\"}},\n";
+    }
+    trace << std::fixed << std::setprecision(3);
+    for(size_t i = 0; i < events.size(); i++) {
+        const MergedEvent& ev = events[i];
+        trace << "  {\"name\": \"" << ev.name << "\", \"ph\": \"X\", \"pid\": " << ev.rank << ", \"tid\": 0"
+              << ", \"ts\": " << (ev.ts - t0) / 1000.0 << ", \"dur\": " << ev.dur / 1000.0;
+        if(ev.raw > 0) {
+            trace << ", \"args\": {\"peer\": " << ev.peer << ", \"bytes\": " << ev.bytes << ", \"raw_bytes\": " << ev.raw
+                  << ", \"ratio\": " << (double)ev.raw / ev.bytes << "}";
+        }
+        else if(ev.peer >= 0) {
+            trace << ", \"args\": {\"peer\": " << ev.peer << ", \"bytes\": " << ev.bytes << "}";
+        }
+        trace << "}" << ((i + 1 < events.size()) ? "," : "") << "\n";
+    }
+    trace << "]}\n";
+
+    summary << std::fixed << std::setprecision(3);
+    summary << "rank  serialize_ms  syscall_ms  wait_ms  msgs_sent  bytes_sent  msgs_recv  bytes_recv\n";
+    for(int r = 0; r < nprocs; r++) {
+        const RankTotals& rt = totals[r];
+        summary << std::setw(4) << r
+                << std::setw(14) << rt.phase[PROF_SERIALIZE] / 1e6
+                << std::setw(12) << rt.phase[PROF_SYSCALL] / 1e6
+                << std::setw(9) << rt.phase[PROF_WAIT] / 1e6
+                << std::setw(11) << rt.msgsSent << std::setw(12) << rt.bytesSent
+                << std::setw(11) << rt.msgsRecv << std::setw(12) << rt.bytesRecv << "\n";
+    }
+    summary << "\ncollective            calls   total_ms (all ranks)\n";
+    for(std::map<std::string, CallStats>::iterator it = allCalls.begin(); it != allCalls.end(); it++) {
+        summary << std::left << std::setw(20) << it->first << std::right
+                << std::setw(8) << it->second.calls << std::setw(11) << it->second.ns / 1e6 << "\n";
+    }
+    if(!allCodecs.empty()) {
+        summary << "\ncodec           msgs   raw_bytes  wire_bytes   ratio  encode_ms (all ranks)\n";
+        for(std::map<std::string, CodecStats>::iterator it = allCodecs.begin(); it != allCodecs.end(); it++) {
+            const CodecStats& cs = it->second;
+            summary << std::left << std::setw(12) << it->first << std::right << std::setw(8) << cs.msgs
+                    << std::setw(12) << cs.rawBytes << std::setw(12) << cs.wireBytes
+                    << std::setw(8) << ((cs.wireBytes > 0) ? (double)cs.rawBytes / cs.wireBytes : 0.0)
+                    << std::setw(11) << cs.ns / 1e6 << "\n";
+        }
+    }
+    summary << "\nbytes sent (row: sender, column: receiver)\n";
+    for(int r = 0; r < nprocs; r++) {
+        for(int j = 0; j < nprocs; j++) {
+            summary << std::setw(10) << totals[r].peerBytes[j];
+        }
+        summary << "\n";
+    }
+    summary << "\n" << events.size() << " timeline events written to " << traceFile << std::endl;
+    return missing;
+}
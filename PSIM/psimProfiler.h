@@ -0,0 +1,117 @@
+//
+//  psimProfiler.h
+//  PSIM
+//
+//  Per-rank communication profiler for PSim. Disabled by default; every hook is a
+//  single branch on 'enabled' until profiling is switched on, either with
+//  PSim::profile() or through the environment:
+//
+//      PSIM_PROFILE=<prefix>   record counters, dump to <prefix>.<rank>.prof
+//      PSIM_TRACE=1            also record a per-event timeline
+//
+//  Files are named by the rank's process in its pool (or standalone PSim, or socket
+//  mesh), not by its rank in a session, and peers are recorded the same way: each
+//  process appends one section per PSim session to its own file when the PSim is
+//  destroyed. Stale files of an earlier run are removed once, when the pool is
+//  created. Profiler::merge() turns the per-rank files into a single Chrome trace
+//  (chrome://tracing, ui.perfetto.dev) and prints a summary table.
+//
+
+#ifndef __PSIM__psimProfiler__
+#define __PSIM__psimProfiler__
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+
+
+enum ProfPhase {
+    PROF_SERIALIZE,     //building / parsing archives
+    PROF_SYSCALL,       //read() / write() on the transport
+    PROF_WAIT,          //blocked until a message arrived
+    PROF_NPHASES
+};
+
+static const char* const PROF_PHASE_NAMES[PROF_NPHASES] = {"serialize", "syscall", "wait"};
+
+
+class Profiler {
+public:
+
+    Profiler();
+
+    void start(int rank, int nprocs, const std::vector<int>& groupOf);
+    void enable(const std::string& prefix, bool timeline);
+    void dump();
+
+    static void prepare(int first, int count);
+
+    static long long now_ns();
+
+    void add_phase(ProfPhase phase, long long t0);
+    void add_message(bool sent, int peer, size_t bytes, long long t0);
+    void add_payload(bool sent, int peer, size_t bytes);
+    void add_call(const char* name, long long t0);
+    void add_codec(const char* codec, int peer, size_t rawBytes, size_t wireBytes, long long t0);
+
+    static int merge(const std::string& prefix, int nprocs, const std::string& traceFile, std::ostream& summary);
+
+    struct Event {
+        const char* name;
+        long long ts;       //ns, steady clock (shared by all ranks on one host)
+        long long dur;
+        int peer;
+        long long bytes;
+        long long raw;      //encode events: bytes before encoding
+    };
+
+    struct CallStats {
+        long long calls;
+        long long ns;
+    };
+
+    struct CodecStats {
+        long long msgs;
+        long long rawBytes;     //4 bytes per int
+        long long wireBytes;    //encoded frame
+        long long ns;           //time spent encoding
+    };
+
+    bool enabled;
+    bool timeline;
+    int rank;
+    int nprocs;
+    int session;                //n-th session over these members, the same on all of them
+    std::vector<int> groupOf;   //groupOf[j]: pool rank of session rank j
+    std::string prefix;
+
+    long long phaseNs[PROF_NPHASES];
+    std::vector<long long> msgsSent, bytesSent, msgsRecv, bytesRecv;   //indexed by peer
+    std::map<std::string, CallStats> calls;
+    std::map<std::string, CodecStats> codecs;
+    std::vector<Event> events;
+};
+
+
+/*
+ *  Scoped timers. Both read the clock only when profiling is enabled.
+ */
+struct PhaseTimer {
+    PhaseTimer(Profiler& p, ProfPhase ph) : prof(p), phase(ph), t0(p.enabled ? Profiler::now_ns() : 0) {}
+    ~PhaseTimer() { if(prof.enabled) prof.add_phase(phase, t0); }
+    Profiler& prof;
+    ProfPhase phase;
+    long long t0;
+};
+
+struct CallTimer {
+    CallTimer(Profiler& p, const char* n) : prof(p), name(n), t0(p.enabled ? Profiler::now_ns() : 0) {}
+    ~CallTimer() { if(prof.enabled) prof.add_call(name, t0); }
+    Profiler& prof;
+    const char* name;
+    long long t0;
+};
+
+#endif /* defined(__PSIM__psimProfiler__) */
@@ -0,0 +1,517 @@
+//
+//  psimSocket.cpp
+//  PSIM
+//
+
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include "psimSocket.h"
+
+SocketAddress::SocketAddress() {
+    transport = TRANSPORT_TCP;
+    port = 0;
+}
+
+/*
+ *  tcp:<host>:<port> | unix:<path> (a bare <host>:<port> is TCP)
+ */
+bool SocketAddress::parse(const std::string& text) {
+    if(text.compare(0, 5, "unix:") == 0) {
+        transport = TRANSPORT_UNIX;
+        host = text.substr(5);
+        port = 0;
+        return !host.empty() && host.size() < sizeof(((struct sockaddr_un*)NULL)->sun_path);
+    }
+    std::string rest = (text.compare(0, 4, "tcp:") == 0) ? text.substr(4) : text;
+    size_t colon = rest.rfind(':');
+    if(colon == std::string::npos || colon == 0 || colon + 1 == rest.size()) {
+        return false;
+    }
+    char* end = NULL;
+    long value = strtol(rest.c_str() + colon + 1, &end, 10);
+    if(*end != '\0' || value < 0 || value > 65535) {
+        return false;
+    }
+    transport = TRANSPORT_TCP;
+    host = rest.substr(0, colon);
+    port = static_cast<int>(value);
+    return true;
+}
+
+std::string SocketAddress::str() const {
+    std::ostringstream os;
+    if(transport == TRANSPORT_UNIX) {
+        os << "unix:" << host;
+    }
+    else {
+        os << "tcp:" << host << ":" << port;
+    }
+    return os.str();
+}
+
+SocketOptions::SocketOptions() {
+    rank = 0;
+    nprocs = 1;
+    bufferBytes = 4 << 20;
+    timeoutMs = 30000;
+}
+
+//False when this process was not launched as a socket rank (PSIM_RENDEZVOUS unset)
+bool SocketOptions::from_env(SocketOptions& opts) {
+    const char* rendezvous = getenv("PSIM_RENDEZVOUS");
+    const char* rank = getenv("PSIM_RANK");
+    const char* nprocs = getenv("PSIM_NPROCS");
+    if(rendezvous == NULL || rank == NULL || nprocs == NULL) {
+        return false;
+    }
+    opts.rendezvous = rendezvous;
+    opts.rank = atoi(rank);
+    opts.nprocs = atoi(nprocs);
+    if(const char* env = getenv("PSIM_SOCKET_BUFFER")) {
+        opts.bufferBytes = atoi(env);
+    }
+    if(const char* env = getenv("PSIM_CONNECT_TIMEOUT")) {
+        opts.timeoutMs = atoi(env);
+    }
+    return opts.nprocs > 0 && opts.rank >= 0 && opts.rank < opts.nprocs;
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Bootstrap helpers. A rank that cannot join the mesh cannot run anything, so every
+ *  failure here is fatal.
+ */
+
+static void socket_fail(const std::string& what, int err) {
+    std::cerr << "PSim socket: " << what;
+    if(err != 0) {
+        std::cerr << ": " << strerror(err);
+    }
+    std::cerr << std::endl;
+    exit(1);
+}
+
+static long long now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ *  Buffer sizes are set before connect()/listen() so TCP can scale its window to them
+ *  (accepted sockets inherit the listener's). Linux caps them at net.core.wmem_max and
+ *  rmem_max.
+ */
+static void tune(int fd, SocketTransport transport, int bufferBytes) {
+    if(bufferBytes > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufferBytes, sizeof(bufferBytes));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+    }
+    if(transport == TRANSPORT_TCP) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+}
+
+static bool resolve(const SocketAddress& addr, bool passive, struct sockaddr_storage& out, socklen_t& len) {
+    memset(&out, 0, sizeof(out));
+    if(addr.transport == TRANSPORT_UNIX) {
+        struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&out);
+        un->sun_family = AF_UNIX;
+        strncpy(un->sun_path, addr.host.c_str(), sizeof(un->sun_path) - 1);
+        len = sizeof(struct sockaddr_un);
+        return true;
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    struct addrinfo* res = NULL;
+    std::string port = std::to_string(addr.port);
+    if(getaddrinfo(addr.host.c_str(), port.c_str(), &hints, &res) != 0 || res == NULL) {
+        return false;
+    }
+    memcpy(&out, res->ai_addr, res->ai_addrlen);
+    len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+//Listen on 'addr'; a TCP port of 0 is replaced by the port the system picked
+static int listen_on(SocketAddress& addr, int bufferBytes, int backlog) {
+    struct sockaddr_storage sa;
+    socklen_t len;
+    if(!resolve(addr, true, sa, len)) {
+        socket_fail("cannot resolve " + addr.str(), 0);
+    }
+    int fd = socket(sa.ss_family, SOCK_STREAM, 0);
+    if(fd < 0) {
+        socket_fail("socket", errno);
+    }
+    if(addr.transport == TRANSPORT_TCP) {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    else {
+        unlink(addr.host.c_str());
+    }
+    tune(fd, addr.transport, bufferBytes);
+    if(bind(fd, reinterpret_cast<struct sockaddr*>(&sa), len) != 0) {
+        socket_fail("bind " + addr.str(), errno);
+    }
+    if(listen(fd, backlog) != 0) {
+        socket_fail("listen " + addr.str(), errno);
+    }
+    if(addr.transport == TRANSPORT_TCP && addr.port == 0) {
+        len = sizeof(sa);
+        getsockname(fd, reinterpret_cast<struct sockaddr*>(&sa), &len);
+        addr.port = ntohs((sa.ss_family == AF_INET6) ? reinterpret_cast<struct sockaddr_in6*>(&sa)->sin6_port
+                                                     : reinterpret_cast<struct sockaddr_in*>(&sa)->sin_port);
+    }
+    return fd;
+}
+
+//Connect to 'addr', retrying while the peer is not listening yet
+static int connect_to(const SocketAddress& addr, int bufferBytes, long long deadline) {
+    while(true) {
+        struct sockaddr_storage sa;
+        socklen_t len;
+        if(resolve(addr, false, sa, len)) {
+            int fd = socket(sa.ss_family, SOCK_STREAM, 0);
+            if(fd < 0) {
+                socket_fail("socket", errno);
+            }
+            tune(fd, addr.transport, bufferBytes);
+            if(connect(fd, reinterpret_cast<struct sockaddr*>(&sa), len) == 0) {
+                return fd;
+            }
+            int err = errno;
+            close(fd);
+            if(err != ECONNREFUSED && err != ENOENT && err != EINTR && err != ETIMEDOUT && err != EAGAIN) {
+                socket_fail("connect " + addr.str(), err);
+            }
+        }
+        if(now_ms() > deadline) {
+            socket_fail("timed out connecting to " + addr.str(), 0);
+        }
+        usleep(10000);
+    }
+}
+
+static int accept_from(int listenFd, SocketTransport transport, int bufferBytes, long long deadline) {
+    struct pollfd pfd = {listenFd, POLLIN, 0};
+    while(true) {
+        int n = poll(&pfd, 1, static_cast<int>(std::max(0LL, deadline - now_ms())));
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0) {
+            socket_fail("poll", errno);
+        }
+        if(n == 0) {
+            socket_fail("timed out waiting for peers to connect", 0);
+        }
+        int fd = accept(listenFd, NULL, NULL);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            socket_fail("accept", errno);
+        }
+        tune(fd, transport, bufferBytes);
+        return fd;
+    }
+}
+
+static void put_all(int fd, const void* buf, size_t n) {
+    const char* p = static_cast<const char*>(buf);
+    while(n > 0) {
+        ssize_t w = write(fd, p, n);
+        if(w < 0 && errno == EINTR) {
+            continue;
+        }
+        if(w < 0) {
+            socket_fail("bootstrap write", errno);
+        }
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+}
+
+static void get_all(int fd, void* buf, size_t n) {
+    char* p = static_cast<char*>(buf);
+    while(n > 0) {
+        ssize_t r = read(fd, p, n);
+        if(r < 0 && errno == EINTR) {
+            continue;
+        }
+        if(r <= 0) {
+            socket_fail("peer hung up during bootstrap", (r < 0) ? errno : 0);
+        }
+        p += r;
+        n -= static_cast<size_t>(r);
+    }
+}
+
+//Bootstrap integers travel in network byte order: the ranks may be different machines
+static void put_int(int fd, int value) {
+    uint32_t x = htonl(static_cast<uint32_t>(value));
+    put_all(fd, &x, sizeof(x));
+}
+
+static int get_int(int fd) {
+    uint32_t x = 0;
+    get_all(fd, &x, sizeof(x));
+    return static_cast<int>(ntohl(x));
+}
+
+static void put_string(int fd, const std::string& s) {
+    put_int(fd, static_cast<int>(s.size()));
+    put_all(fd, s.data(), s.size());
+}
+
+static std::string get_string(int fd) {
+    std::string s(static_cast<size_t>(get_int(fd)), '\0');
+    if(!s.empty()) {
+        get_all(fd, &s[0], s.size());
+    }
+    return s;
+}
+
+/*
+ *  Where a rank other than 0 listens for its peers. Over TCP that is the local address
+ *  of its connection to rank 0 (the interface that reaches the other machines) on a
+ *  port the system picks; over Unix sockets it is the rendezvous path plus the rank.
+ */
+static SocketAddress listener_address(const SocketAddress& rendezvous, int rendezvousFd, int rank) {
+    SocketAddress mine;
+    mine.transport = rendezvous.transport;
+    if(rendezvous.transport == TRANSPORT_UNIX) {
+        mine.host = rendezvous.host + "." + std::to_string(rank);
+        return mine;
+    }
+    struct sockaddr_storage sa;
+    socklen_t len = sizeof(sa);
+    char host[NI_MAXHOST];
+    if(getsockname(rendezvousFd, reinterpret_cast<struct sockaddr*>(&sa), &len) != 0 ||
+       getnameinfo(reinterpret_cast<struct sockaddr*>(&sa), len, host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0) {
+        socket_fail("cannot find the local address", errno);
+    }
+    mine.host = host;
+    mine.port = 0;
+    return mine;
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Join the mesh described by 'opts' (see the protocol in psimSocket.h). Returns once
+ *  this rank holds a socket to every other rank.
+ */
+SocketMesh::SocketMesh(const SocketOptions& opts, const Placement& place) {
+    nprocs = opts.nprocs;
+    rank = opts.rank;
+    placement = place;
+    bufferBytes = opts.bufferBytes;
+    timeoutMs = opts.timeoutMs;
+    if(!rendezvous.parse(opts.rendezvous)) {
+        socket_fail("bad rendezvous address " + opts.rendezvous, 0);
+    }
+    transport = (rendezvous.transport == TRANSPORT_UNIX) ? "unix" : "tcp";
+    //a peer that dies shows up as EPIPE on the next write instead of killing this rank
+    signal(SIGPIPE, SIG_IGN);
+
+    long long deadline = now_ms() + timeoutMs;
+    outFd.assign(nprocs, -1);
+    inFd.assign(nprocs, -1);
+    std::vector<SocketAddress> table(nprocs);
+    table[0] = rendezvous;
+    SocketAddress mine = rendezvous;
+    int listenFd = -1;
+
+    if(rank == 0) {
+        //rendezvous: learn every rank's listener, then hand out the table
+        if(nprocs > 1) {
+            listenFd = listen_on(mine, bufferBytes, nprocs);
+        }
+        for(int i = 1; i < nprocs; i++) {
+            int fd = accept_from(listenFd, rendezvous.transport, bufferBytes, deadline);
+            int r = get_int(fd);
+            int p = get_int(fd);
+            std::string addr = get_string(fd);
+            if(p != nprocs || r <= 0 || r >= nprocs || outFd[r] >= 0) {
+                socket_fail("rank " + std::to_string(r) + " of " + std::to_string(p) + " does not fit a mesh of " +
+                            std::to_string(nprocs), 0);
+            }
+            outFd[r] = inFd[r] = fd;
+            table[r].parse(addr);
+        }
+        for(int r = 1; r < nprocs; r++) {
+            for(int i = 0; i < nprocs; i++) {
+                put_string(outFd[r], table[i].str());
+            }
+        }
+    }
+    else {
+        int fd = connect_to(rendezvous, bufferBytes, deadline);
+        outFd[0] = inFd[0] = fd;
+        mine = listener_address(rendezvous, fd, rank);
+        listenFd = listen_on(mine, bufferBytes, nprocs);
+        put_int(fd, rank);
+        put_int(fd, nprocs);
+        put_string(fd, mine.str());
+        for(int i = 0; i < nprocs; i++) {
+            table[i].parse(get_string(fd));
+        }
+
+        //mesh: connect down to ranks 1..rank-1, accept from rank+1..p-1
+        for(int j = 1; j < rank; j++) {
+            int peer = connect_to(table[j], bufferBytes, deadline);
+            put_int(peer, rank);
+            outFd[j] = inFd[j] = peer;
+        }
+        for(int i = rank + 1; i < nprocs; i++) {
+            int peer = accept_from(listenFd, rendezvous.transport, bufferBytes, deadline);
+            int r = get_int(peer);
+            if(r <= rank || r >= nprocs || outFd[r] >= 0) {
+                socket_fail("unexpected connection from rank " + std::to_string(r), 0);
+            }
+            outFd[r] = inFd[r] = peer;
+        }
+    }
+    if(listenFd >= 0) {
+        close(listenFd);
+        if(mine.transport == TRANSPORT_UNIX) {
+            unlink(mine.host.c_str());
+        }
+    }
+
+    //messages to self go through a local socket pair
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        socket_fail("socketpair", errno);
+    }
+    tune(sv[0], TRANSPORT_UNIX, bufferBytes);
+    tune(sv[1], TRANSPORT_UNIX, bufferBytes);
+    outFd[rank] = sv[0];
+    inFd[rank] = sv[1];
+
+    //pinning is per machine: the map only makes sense when the ranks share one
+    cpuOf = placement.map(nprocs, SWITCH);
+    if(cpuOf[rank] >= 0) {
+        placement.pin(cpuOf[rank]);
+    }
+    //the ranks may not share a file system, so each clears only its own profile
+    Profiler::prepare(rank, 1);
+}
+
+/*
+ *  Leave the mesh. Every rank stops writing, then reads each peer until it hangs up,
+ *  so no rank closes a socket the other side is still draining (closing a TCP socket
+ *  with unread data resets the connection and can drop what the peer has not read).
+ */
+SocketMesh::~SocketMesh() {
+    for(int j = 0; j < nprocs; j++) {
+        if(j != rank) {
+            shutdown(outFd[j], SHUT_WR);
+        }
+    }
+    char buf[4096];
+    for(int j = 0; j < nprocs; j++) {
+        if(j == rank) {
+            continue;
+        }
+        long long unread = 0;
+        ssize_t n;
+        while((n = read(inFd[j], buf, sizeof(buf))) != 0) {
+            if(n < 0 && errno != EINTR) {
+                break;
+            }
+            unread += (n > 0) ? n : 0;
+        }
+        if(unread > 0) {
+            std::cerr << "PSim socket: rank " << rank << " discarded " << unread << " unread bytes from rank " << j << std::endl;
+        }
+    }
+    for(int j = 0; j < nprocs; j++) {
+        close(outFd[j]);
+        if(inFd[j] != outFd[j]) {
+            close(inFd[j]);
+        }
+    }
+    placement.unpin();
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Start p local copies of 'args' (args[0] is the program) as socket ranks of one mesh
+ *  and wait for all of them. Returns 0 when every rank exits cleanly.
+ */
+int launch_ranks(int p, const std::string& rendezvous, const std::vector<std::string>& args) {
+    if(args.empty() || p < 1) {
+        return 1;
+    }
+    std::cout.flush();
+    fflush(stdout);
+    std::vector<pid_t> pids;
+    for(int r = 0; r < p; r++) {
+        pid_t pid = fork();
+        if(pid < 0) {
+            perror("PSim launch: fork");
+            break;
+        }
+        if(pid == 0) {
+            setenv("PSIM_RANK", std::to_string(r).c_str(), 1);
+            setenv("PSIM_NPROCS", std::to_string(p).c_str(), 1);
+            setenv("PSIM_RENDEZVOUS", rendezvous.c_str(), 1);
+            std::vector<char*> argv;
+            for(size_t i = 0; i < args.size(); i++) {
+                argv.push_back(const_cast<char*>(args[i].c_str()));
+            }
+            argv.push_back(NULL);
+            execvp(argv[0], &argv[0]);
+            perror("PSim launch: exec");
+            _exit(127);
+        }
+        pids.push_back(pid);
+    }
+    int status = (static_cast<int>(pids.size()) == p) ? 0 : 1;
+    for(size_t i = 0; i < pids.size(); i++) {
+        int ws = 0;
+        while(waitpid(pids[i], &ws, 0) < 0 && errno == EINTR) {
+        }
+        if(!WIFEXITED(ws) || WEXITSTATUS(ws) != 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/*
+ *  A rendezvous address on this machine: a free loopback port, or a socket path under
+ *  /tmp named after this process.
+ */
+std::string local_rendezvous(SocketTransport transport) {
+    if(transport == TRANSPORT_UNIX) {
+        return "unix:/tmp/psim." + std::to_string(getpid()) + ".sock";
+    }
+    SocketAddress addr;
+    addr.host = "127.0.0.1";
+    int fd = listen_on(addr, 0, 1);
+    close(fd);
+    return addr.str();
+}
@@ -0,0 +1,85 @@
+//
+//  psimSocket.h
+//  PSIM
+//
+//  Socket transport for PSim. Ranks are separate programs, possibly on different
+//  machines, that find each other through a rendezvous address:
+//
+//  1. rank 0 listens on the rendezvous address; every other rank opens a listener of
+//     its own, connects to rank 0 and reports its rank and listener address
+//  2. rank 0 sends the full address table back over the same connections
+//  3. every rank i > 0 connects to the listeners of ranks 1..i-1 and accepts from
+//     ranks i+1..p-1, so each pair of ranks shares one stream socket
+//
+//  Rendezvous addresses are "tcp:<host>:<port>" or "unix:<path>". TCP channels run
+//  with TCP_NODELAY (PSim writes every frame with a single writev, so small messages
+//  are not held back by Nagle) and with large send/receive buffers for bulk data.
+//  Unix-domain sockets skip the TCP stack when every rank is on one machine.
+//
+//  Launched processes read their place from the environment:
+//      PSIM_RANK, PSIM_NPROCS, PSIM_RENDEZVOUS   required
+//      PSIM_SOCKET_BUFFER                        SO_SNDBUF/SO_RCVBUF bytes (default 4 MiB)
+//      PSIM_CONNECT_TIMEOUT                      ms to wait for peers (default 30000)
+//  launch_ranks() starts p local copies of a command with these set.
+//
+
+#ifndef __PSIM__psimSocket__
+#define __PSIM__psimSocket__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "psim.h"
+
+
+enum SocketTransport {
+    TRANSPORT_TCP,
+    TRANSPORT_UNIX
+};
+
+struct SocketAddress {
+    SocketTransport transport;
+    std::string host;           //TCP host name or IP, or the Unix socket path
+    int port;                   //TCP only
+
+    SocketAddress();
+    bool parse(const std::string& text);
+    std::string str() const;
+};
+
+struct SocketOptions {
+    int rank;
+    int nprocs;
+    std::string rendezvous;
+    int bufferBytes;            //SO_SNDBUF/SO_RCVBUF (0 = system default)
+    int timeoutMs;              //give up on connect/accept after this long
+
+    SocketOptions();
+    static bool from_env(SocketOptions& opts);
+};
+
+
+/*
+ *  A RankGroup whose channels are sockets. Every rank constructs one with its own
+ *  options and builds PSim sessions on it like on a RankPool; unlike a pool nothing is
+ *  forked, so every rank returns from the destructor, which also acts as a final
+ *  barrier (each rank drains its peers until they hang up).
+ */
+class SocketMesh : public RankGroup {
+public:
+
+    SocketMesh(const SocketOptions& opts, const Placement& place = Placement::from_env());
+    ~SocketMesh();
+
+    SocketAddress rendezvous;
+    int bufferBytes;
+
+private:
+    int timeoutMs;
+};
+
+
+int launch_ranks(int p, const std::string& rendezvous, const std::vector<std::string>& args);
+std::string local_rendezvous(SocketTransport transport);
+
+#endif /* defined(__PSIM__psimSocket__) */
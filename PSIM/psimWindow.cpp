@@ -0,0 +1,252 @@
+//
+//  psimWindow.cpp
+//  PSIM
+//
+
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sstream>
+#include "psimWindow.h"
+#include "psimKernels.h"
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  A window that cannot be mapped, or an access outside a rank's region, leaves the
+ *  ranks disagreeing about shared state, so both are fatal.
+ */
+
+static void window_fail(const std::string& what, int err) {
+    std::cerr << "PSim window: " << what;
+    if(err != 0) {
+        std::cerr << ": " << strerror(err);
+    }
+    std::cerr << std::endl;
+    exit(1);
+}
+
+//POSIX shm names are short on some systems (31 characters on macOS)
+static std::string shm_name(int pid, int seq) {
+    std::ostringstream name;
+    name << "/psim." << pid << "." << seq;
+    return name.str();
+}
+
+static size_t round_up(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+//Atomically replace *p with binop(*p, value); returns the previous value
+static int apply_atomic(int* p, int value, std::function<int(int, int)>& binop) {
+    int old = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(p, &old, binop(old, value), true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    }
+    return old;
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Collective. Every rank exposes 'count' ints (counts may differ between ranks, and
+ *  are exchanged as 64-bit values, so a region may exceed 2^31 ints). The arena holds one lock word per rank, then the regions in rank order:
+ *
+ *      [lock 0][lock 1]...[lock p-1][region 0][region 1]...[region p-1]
+ *
+ *  each starting on its own cache line. Rank 0 creates and sizes the shared memory
+ *  object, the others open it, and once every rank has mapped it rank 0 unlinks the
+ *  name, so the memory goes away with the last mapping even if a rank crashes.
+ */
+Window::Window(PSim& c, size_t count) : comm(c), arena(NULL), arenaBytes(0) {
+    CallTimer ct(comm.prof, "win_create");
+    int p = comm.nprocs;
+    std::vector<long long> mine(p, 0);
+    mine[comm.rank] = static_cast<long long>(count);
+    std::vector<long long> sizes = sum_counts(comm, mine);
+    counts.resize(p);
+    offsets.resize(p);
+    size_t at = p * WINDOW_LINE;
+    for(int j = 0; j < p; j++) {
+        counts[j] = static_cast<size_t>(sizes[j]);
+        offsets[j] = at;
+        at += round_up(counts[j] * sizeof(int), WINDOW_LINE);
+    }
+    arenaBytes = at;
+    held.assign(p, -1);
+
+    //rank 0 names the object after its pid and a per-process sequence number and
+    //broadcasts both; a pid of 0 means it could not create it
+    static int created = 0;
+    int pid = 0;
+    int seq = 0;
+    int fd = -1;
+    int err = 0;
+    if(comm.rank == 0) {
+        seq = created++;
+        fd = shm_open(shm_name(getpid(), seq).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd >= 0 && ftruncate(fd, arenaBytes) == 0) {
+            pid = getpid();
+        }
+        else {
+            err = errno;
+        }
+    }
+    pid = comm.one2all_broadcast(0, pid);
+    seq = comm.one2all_broadcast(0, seq);
+    if(pid == 0) {
+        if(fd >= 0) {
+            close(fd);
+            shm_unlink(shm_name(getpid(), seq).c_str());
+        }
+        window_fail("cannot create shared memory", err);
+    }
+    std::string name = shm_name(pid, seq);
+    if(comm.rank != 0) {
+        fd = shm_open(name.c_str(), O_RDWR, 0);
+    }
+
+    void* mem = MAP_FAILED;
+    if(fd >= 0) {
+        mem = mmap(NULL, arenaBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    if(mem == MAP_FAILED) {
+        err = errno;
+    }
+
+    //every rank has to have mapped the arena before it can be unlinked
+    int mapped = comm.all2all_reduce((mem != MAP_FAILED) ? 1 : 0, min);
+    if(comm.rank == 0) {
+        shm_unlink(name.c_str());
+    }
+    if(!mapped) {
+        window_fail("cannot map " + name + " (are all ranks on one machine?)", err);
+    }
+    arena = static_cast<char*>(mem);
+}
+
+Window::~Window() {
+    for(int j = 0; j < comm.nprocs; j++) {
+        if(held[j] >= 0) {
+            unlock(j);
+        }
+    }
+    if(arena != NULL) {
+        munmap(arena, arenaBytes);
+    }
+}
+
+int* Window::slot(int target, size_t offset, size_t n) const {
+    if(target < 0 || target >= comm.nprocs || offset > counts[target] || n > counts[target] - offset) {
+        std::ostringstream what;
+        what << "rank " << comm.rank << " accessed [" << offset << ", " << offset + n << ") of rank "
+             << target << "'s region";
+        window_fail(what.str(), 0);
+    }
+    return region(target) + offset;
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Data movement. put and get are plain copies: they are only guaranteed to be seen
+ *  (or to see other ranks' writes) across a fence or a lock/unlock of the target.
+ */
+
+void Window::put(int target, size_t offset, const int* data, size_t n) {
+    CallTimer ct(comm.prof, "win_put");
+    memcpy(slot(target, offset, n), data, n * sizeof(int));
+    if(comm.prof.enabled) {
+        comm.prof.add_payload(true, target, n * sizeof(int));
+    }
+}
+
+void Window::put(int target, size_t offset, const std::vector<int>& data) {
+    put(target, offset, data.data(), data.size());
+}
+
+void Window::get(int target, size_t offset, int* out, size_t n) {
+    CallTimer ct(comm.prof, "win_get");
+    memcpy(out, slot(target, offset, n), n * sizeof(int));
+    if(comm.prof.enabled) {
+        comm.prof.add_payload(false, target, n * sizeof(int));
+    }
+}
+
+std::vector<int> Window::get(int target, size_t offset, size_t n) {
+    std::vector<int> out(n);
+    get(target, offset, out.data(), n);
+    return out;
+}
+
+/*
+ *  region[offset + i] = binop(region[offset + i], data[i]), each element atomically.
+ *  Concurrent accumulates to one element from different ranks are all applied, in
+ *  some order, so 'binop' should be commutative and associative (sum, min, max...).
+ */
+void Window::accumulate(int target, size_t offset, const int* data, size_t n, std::function<int(int, int)>& binop) {
+    CallTimer ct(comm.prof, "win_accumulate");
+    int* dst = slot(target, offset, n);
+    for(size_t i = 0; i < n; i++) {
+        apply_atomic(dst + i, data[i], binop);
+    }
+    if(comm.prof.enabled) {
+        comm.prof.add_payload(true, target, n * sizeof(int));
+    }
+}
+
+int Window::fetch_and_op(int target, size_t offset, int value, std::function<int(int, int)>& binop) {
+    return apply_atomic(slot(target, offset, 1), value, binop);
+}
+
+//Returns the value found; the swap happened if it equals 'expected'
+int Window::compare_and_swap(int target, size_t offset, int expected, int desired) {
+    __atomic_compare_exchange_n(slot(target, offset, 1), &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return expected;
+}
+
+//------------------------------------------------------------------------------------------------
+
+/*
+ *  Synchronization. The barrier goes through the session's channels, which already
+ *  orders memory on every platform PSim runs on; the fences make it explicit.
+ */
+void Window::fence() {
+    CallTimer ct(comm.prof, "win_fence");
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    comm.barrier();
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*
+ *  Reader-writer spin lock on one rank's region. The lock word is 0 when free, -1
+ *  while held exclusively and the number of readers while shared. Waiters yield the
+ *  CPU, since ranks are often oversubscribed.
+ */
+void Window::lock(int target, WindowLock type) {
+    CallTimer ct(comm.prof, "win_lock");
+    int* word = lock_word(target);
+    while(true) {
+        int cur = __atomic_load_n(word, __ATOMIC_RELAXED);
+        bool free = (type == LOCK_EXCLUSIVE) ? (cur == 0) : (cur >= 0);
+        int next = (type == LOCK_EXCLUSIVE) ? -1 : cur + 1;
+        if(free && __atomic_compare_exchange_n(word, &cur, next, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        sched_yield();
+    }
+    held[target] = type;
+}
+
+void Window::unlock(int target) {
+    int* word = lock_word(target);
+    if(held[target] == LOCK_EXCLUSIVE) {
+        __atomic_store_n(word, 0, __ATOMIC_RELEASE);
+    }
+    else if(held[target] == LOCK_SHARED) {
+        __atomic_fetch_sub(word, 1, __ATOMIC_RELEASE);
+    }
+    held[target] = -1;
+}
@@ -0,0 +1,84 @@
+//
+//  psimWindow.h
+//  PSIM
+//
+//  One-sided communication for PSim. A Window is an arena of POSIX shared memory
+//  (shm_open + mmap) that every rank of a session maps; each rank exposes its own
+//  region of ints in it, and any rank can read or write any region without the owner
+//  taking part:
+//
+//      put / get           copy ints into / out of a rank's region
+//      accumulate          combine ints into a region with a binop, element-wise atomic
+//      fetch_and_op        atomic read-modify-write of one int, returning the old value
+//      compare_and_swap    atomic compare-and-swap of one int
+//      view                direct pointer to a rank's region (zero-copy reads)
+//
+//  Accesses happen inside synchronization epochs, as in MPI:
+//
+//      fence()             collective; everything written before any rank's fence is
+//                          visible to every rank after it
+//      lock(target) / unlock(target)
+//                          passive target: a shared or exclusive lock on one rank's
+//                          region, taken without the owner's involvement
+//
+//  accumulate, fetch_and_op and compare_and_swap are atomic per element even outside
+//  an epoch, so counters and work queues need no lock. Creating a window is collective
+//  (every rank of the session, in the same order); destroying it is not. Every rank
+//  must be on one machine, which rules out socket meshes spanning hosts.
+//
+
+#ifndef __PSIM__psimWindow__
+#define __PSIM__psimWindow__
+
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "psim.h"
+
+
+enum WindowLock {
+    LOCK_SHARED,
+    LOCK_EXCLUSIVE
+};
+
+
+class Window {
+public:
+
+    Window(PSim& comm, size_t count);
+    ~Window();
+
+    size_t size(int target) const { return counts[target]; }
+    int* local() { return region(comm.rank); }
+    const int* view(int target) const { return region(target); }
+
+    void put(int target, size_t offset, const int* data, size_t n);
+    void put(int target, size_t offset, const std::vector<int>& data);
+    void get(int target, size_t offset, int* out, size_t n);
+    std::vector<int> get(int target, size_t offset, size_t n);
+    void accumulate(int target, size_t offset, const int* data, size_t n, std::function<int(int, int)>& binop);
+    int fetch_and_op(int target, size_t offset, int value, std::function<int(int, int)>& binop);
+    int compare_and_swap(int target, size_t offset, int expected, int desired);
+
+    void fence();
+    void lock(int target, WindowLock type = LOCK_EXCLUSIVE);
+    void unlock(int target);
+
+    PSim& comm;
+
+private:
+    int* region(int target) const { return reinterpret_cast<int*>(arena + offsets[target]); }
+    int* slot(int target, size_t offset, size_t n) const;
+    int* lock_word(int target) const { return reinterpret_cast<int*>(arena + target * WINDOW_LINE); }
+
+    static const size_t WINDOW_LINE = 64;   //lock words and regions start on their own cache line
+
+    char* arena;
+    size_t arenaBytes;
+    std::vector<size_t> counts;     //counts[j]: ints exposed by rank j
+    std::vector<size_t> offsets;    //offsets[j]: byte offset of rank j's region
+    std::vector<int> held;          //held[j]: WindowLock this rank holds on j (-1 none)
+};
+
+#endif /* defined(__PSIM__psimWindow__) */
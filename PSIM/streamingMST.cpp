@@ -0,0 +1,127 @@
+//
+//  streamingMST.cpp
+//  PSIM
+//
+
+#include <algorithm>
+#include "streamingMST.h"
+
+/*
+ *  Constructor taking the filename of a TEXT or BINARY edge list and the number of
+ *  bytes the algorithm may keep resident. Only the file header is read here.
+ */
+StreamingMST::StreamingMST(const char* filename, size_t memoryBudget) {
+    this->filename = filename;
+    this->memoryBudget = memoryBudget;
+    this->chunkEdges = 0;
+    this->nChunks = 0;
+    this->edgesRead = 0;
+    this->edgesDiscarded = 0;
+    this->bytesRead = 0;
+    this->totalWeight = 0;
+
+    EdgeStream header(filename);
+    this->nVerts = header.nVerts;
+    this->nEdges = header.nEdges;
+
+    //Fixed costs: union-find (2 ints per vertex), the forest, and the stream's staging buffer.
+    //Whatever is left over holds streamed edges.
+    size_t fixed = 2 * sizeof(int) * this->nVerts +
+                   sizeof(Edge) * (this->nVerts > 0 ? this->nVerts - 1 : 0) +
+                   3 * sizeof(int32_t) * EDGE_STREAM_BLOCK;
+    if(memoryBudget > fixed) {
+        this->chunkEdges = (memoryBudget - fixed) / sizeof(Edge);
+    }
+}
+
+/*
+ *  Union-find lookup with path halving
+ */
+int StreamingMST::find(int x) {
+    while(this->parent[x] != x) {
+        this->parent[x] = this->parent[this->parent[x]];
+        x = this->parent[x];
+    }
+    return x;
+}
+
+/*
+ *  Kruskal over 'work' (current forest + one chunk). The surviving edges are compacted
+ *  to the front of 'work', which is then truncated to the new forest.
+ */
+void StreamingMST::merge(std::vector<Edge>& work) {
+    std::sort(work.begin(), work.end(), [](const Edge& a, const Edge& b) { return a.weight < b.weight; });
+
+    for(int i = 0; i < this->nVerts; i++) {
+        this->parent[i] = i;
+        this->setSize[i] = 1;
+    }
+
+    size_t kept = 0;
+    for(size_t i = 0; i < work.size(); i++) {
+        int a = this->find(work[i].e[0]);
+        int b = this->find(work[i].e[1]);
+        if(a == b) {
+            continue;
+        }
+        if(this->setSize[a] < this->setSize[b]) {
+            std::swap(a, b);
+        }
+        this->parent[b] = a;
+        this->setSize[a] += this->setSize[b];
+        work[kept++] = work[i];
+    }
+    this->edgesDiscarded += static_cast<long long>(work.size() - kept);
+    work.resize(kept);
+}
+
+/*
+ *  Stream the edge file once, merging each chunk into the running spanning forest.
+ */
+void StreamingMST::run() {
+    if(this->chunkEdges == 0) {
+        std::cerr << "StreamingMST: memory budget of " << this->memoryBudget
+                  << " bytes is too small for " << this->nVerts << " vertices" << std::endl;
+        return;
+    }
+
+    EdgeStream stream(this->filename.c_str());
+    this->parent.resize(this->nVerts);
+    this->setSize.resize(this->nVerts);
+
+    //'work' holds the forest at its front followed by the current chunk
+    std::vector<Edge> work;
+    work.reserve((this->nVerts > 0 ? this->nVerts - 1 : 0) + this->chunkEdges);
+
+    while(stream.read(work, this->chunkEdges) > 0) {
+        this->nChunks++;
+        this->merge(work);
+    }
+    if(!stream.good()) {
+        std::cerr << "StreamingMST: " << this->filename << " stopped after " << stream.edgesRead
+                  << " of " << stream.nEdges << " edges" << std::endl;
+    }
+
+    this->forest.assign(work.begin(), work.end());
+    this->edgesRead = stream.edgesRead;
+    this->bytesRead = stream.bytesRead;
+    this->totalWeight = 0;
+    for(std::vector<Edge>::iterator it = this->forest.begin(); it != this->forest.end(); it++) {
+        this->totalWeight += it->weight;
+    }
+}
+
+/*
+ *  Print the I/O volume and the resulting forest summary
+ */
+void StreamingMST::report(std::ostream& os) const {
+    os << "Streaming MST -- " << this->filename << "\n";
+    os << "Vertices: " << this->nVerts << "\nEdges: " << this->nEdges << "\n";
+    os << "Memory budget: " << this->memoryBudget << " bytes (" << this->chunkEdges << " edges per chunk)\n";
+    os << "Chunks merged: " << this->nChunks << "\n";
+    os << "Edges streamed: " << this->edgesRead << " (" << this->edgesDiscarded << " discarded)\n";
+    os << "Bytes read: " << this->bytesRead << "\n";
+    os << "Forest edges: " << this->forest.size()
+       << " (" << (this->nVerts - static_cast<long long>(this->forest.size())) << " components)\n";
+    os << "Total weight: " << this->totalWeight << std::endl;
+}
@@ -0,0 +1,56 @@
+//
+//  streamingMST.h
+//  PSIM
+//
+//  Out-of-core minimum spanning forest for edge lists larger than RAM.
+//
+
+#ifndef __PSIM__streamingMST__
+#define __PSIM__streamingMST__
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "primsAlgorithm.h"
+#include "edgeStream.h"
+
+
+/*
+ *  Filter-and-merge MST over an EdgeStream. Only the union-find arrays, the current
+ *  minimum spanning forest (at most nVerts-1 edges) and one chunk of streamed edges
+ *  are ever resident. Each chunk is merged with the forest by an in-memory Kruskal
+ *  pass; every edge that does not survive the merge can never be part of the MST
+ *  (it is the heaviest edge on some cycle) and is discarded for good.
+ *
+ *  memoryBudget is in bytes and bounds the resident set described above.
+ */
+class StreamingMST {
+public:
+
+    StreamingMST(const char* filename, size_t memoryBudget);
+    void run();
+    void report(std::ostream& os) const;
+
+    std::vector<Edge> forest;       //the MST (or spanning forest) after run()
+
+    int nVerts;
+    long long nEdges;
+    size_t memoryBudget;
+    size_t chunkEdges;              //streamed edges resident per merge
+    int nChunks;
+    long long edgesRead;
+    long long edgesDiscarded;
+    unsigned long long bytesRead;
+    long long totalWeight;
+
+private:
+    void merge(std::vector<Edge>& work);
+    int find(int x);
+
+    std::string filename;
+    std::vector<int> parent;
+    std::vector<int> setSize;
+};
+
+#endif /* defined(__PSIM__streamingMST__) */
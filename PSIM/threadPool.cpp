@@ -0,0 +1,212 @@
+//
+//  threadPool.cpp
+//  PSIM
+//
+
+#include <stdlib.h>
+#include "threadPool.h"
+
+//The pool and slot of the current thread (none for threads outside any pool)
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local int currentSlot = 0;
+
+//Unfinished tasks submitted by the task this thread is running (none outside tasks)
+static thread_local std::atomic<long long>* currentScope = nullptr;
+
+ThreadPool::ThreadPool(int threads) : queued(0), unfinished(0), parked(0), stopping(false) {
+    this->nthreads = (threads > 0) ? threads : threads_from_env();
+    for(int i = 0; i < this->nthreads; i++) {
+        this->queues.push_back(new TaskQueue());
+    }
+    for(int i = 1; i < this->nthreads; i++) {
+        this->workers.push_back(std::thread(&ThreadPool::work, this, i));
+    }
+}
+
+/*
+ *  Finishes every task still queued, then joins the workers
+ */
+ThreadPool::~ThreadPool() {
+    this->wait();
+    {
+        std::lock_guard<std::mutex> lk(this->sleepLock);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    for(size_t i = 0; i < this->workers.size(); i++) {
+        this->workers[i].join();
+    }
+    for(size_t i = 0; i < this->queues.size(); i++) {
+        delete this->queues[i];
+    }
+}
+
+//PSIM_THREADS threads per rank, default 1
+int ThreadPool::threads_from_env() {
+    const char* env = getenv("PSIM_THREADS");
+    int threads = (env != NULL) ? atoi(env) : 1;
+    return (threads > 0) ? threads : 1;
+}
+
+//Workers use their own slot; any other thread counts as slot 0
+int ThreadPool::slot() const {
+    return (currentPool == this) ? currentSlot : 0;
+}
+
+//Counter the caller's submissions go to: its task's, or the pool's outside any task
+std::atomic<long long>& ThreadPool::scope() {
+    return (currentScope != nullptr) ? *currentScope : this->unfinished;
+}
+
+void ThreadPool::push(const std::function<void()>& task, std::atomic<long long>& left) {
+    TaskQueue* q = this->queues[this->slot()];
+    left++;
+    {
+        std::lock_guard<std::mutex> lk(q->lock);
+        Task t = {task, &left};
+        q->tasks.push_back(t);
+    }
+    this->queued++;
+
+    //a thread that found nothing to do checks 'queued' under sleepLock before it
+    //sleeps, so taking the lock here means it either sees the task or gets the signal.
+    //Waiting threads may be the only ones able to run it, so they are woken too.
+    bool waiters;
+    {
+        std::lock_guard<std::mutex> lk(this->sleepLock);
+        waiters = this->parked > 0;
+    }
+    if(waiters) {
+        this->wake.notify_all();
+    }
+    else {
+        this->wake.notify_one();
+    }
+}
+
+/*
+ *  Run one task: the newest of our own, or else the oldest of another thread's
+ *  (the biggest piece of work it has left). Returns false if every deque was empty.
+ *  Tasks the task submits are counted apart, so a wait() inside it waits for those
+ *  only; any it did not wait for are finished before it counts as done.
+ */
+bool ThreadPool::run_one(int self) {
+    Task task = {std::function<void()>(), nullptr};
+    for(int i = 0; i < this->nthreads && !task.run; i++) {
+        TaskQueue* q = this->queues[(self + i) % this->nthreads];
+        std::lock_guard<std::mutex> lk(q->lock);
+        if(q->tasks.empty()) {
+            continue;
+        }
+        if(i == 0) {
+            std::swap(task, q->tasks.back());
+            q->tasks.pop_back();
+        }
+        else {
+            std::swap(task, q->tasks.front());
+            q->tasks.pop_front();
+        }
+    }
+    if(!task.run) {
+        return false;
+    }
+    this->queued--;
+    std::atomic<long long> children(0);
+    std::atomic<long long>* outer = currentScope;
+    currentScope = &children;
+    task.run();
+    this->help_until(children);
+    currentScope = outer;
+    this->finish(*task.left);
+    return true;
+}
+
+//One of 'left' is done; whoever waits for the last one is woken
+void ThreadPool::finish(std::atomic<long long>& left) {
+    if(--left > 0) {
+        return;
+    }
+    bool waiters;
+    {
+        std::lock_guard<std::mutex> lk(this->sleepLock);
+        waiters = this->parked > 0;
+    }
+    if(waiters) {
+        this->wake.notify_all();
+    }
+}
+
+/*
+ *  Run queued tasks until 'left' drops to 0. With nothing to run (the rest are
+ *  running on other threads) the caller sleeps until a task is queued or the last
+ *  one finishes.
+ */
+void ThreadPool::help_until(std::atomic<long long>& left) {
+    int self = this->slot();
+    while(left > 0) {
+        if(this->run_one(self)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(this->sleepLock);
+        this->parked++;
+        this->wake.wait(lk, [this, &left] { return left == 0 || this->queued > 0; });
+        this->parked--;
+    }
+}
+
+void ThreadPool::work(int self) {
+    currentPool = this;
+    currentSlot = self;
+    while(true) {
+        if(this->run_one(self)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(this->sleepLock);
+        this->wake.wait(lk, [this] { return this->stopping || this->queued > 0; });
+        if(this->stopping && this->queued == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::submit(const std::function<void()>& task) {
+    if(this->nthreads == 1) {
+        task();
+        return;
+    }
+    this->push(task, this->scope());
+}
+
+/*
+ *  Block until every task the caller submitted has run, running queued tasks
+ *  meanwhile. Called from a task, that means the tasks this task submitted.
+ */
+void ThreadPool::wait() {
+    this->help_until(this->scope());
+}
+
+/*
+ *  body(b, e) over a split of [begin, end) into up to 4 blocks per thread of at least
+ *  'grain' iterations each. The caller runs the first block itself and then helps
+ *  with the rest; it returns when all of them are done. Calls nest: a task may run a
+ *  parallel_for of its own.
+ */
+void ThreadPool::parallel_for(long long begin, long long end, const std::function<void(long long, long long)>& body, long long grain) {
+    long long n = end - begin;
+    if(n <= 0) {
+        return;
+    }
+    long long blocks = std::min((n + grain - 1) / std::max(grain, 1LL), 4LL * this->nthreads);
+    if(this->nthreads == 1 || blocks <= 1) {
+        body(begin, end);
+        return;
+    }
+
+    std::atomic<long long> left(0);
+    for(long long b = blocks - 1; b >= 1; b--) {
+        long long b0 = begin + n * b / blocks, b1 = begin + n * (b + 1) / blocks;
+        this->push([&body, b0, b1] { body(b0, b1); }, left);
+    }
+    body(begin, begin + n / blocks);
+    this->help_until(left);
+}
@@ -0,0 +1,109 @@
+//
+//  threadPool.h
+//  PSIM
+//
+//  Work-stealing thread pool for the loops inside one PSim rank. With p ranks of t
+//  threads each, a machine's cores are kept busy by fewer ranks, which means fewer
+//  pipes and shorter collectives than with p*t single-threaded ranks.
+//
+//  Every thread owns a deque of tasks. It pushes and pops its own tasks at the back
+//  and, when that is empty, steals from the front of the others'. The thread that
+//  creates the pool is slot 0 and does its share of every parallel_for instead of
+//  sleeping, so a pool of t threads starts t-1 workers.
+//
+//  Only that thread may communicate: tasks must not call PSim. Threads do not survive
+//  fork(), so a rank creates its pool after the PSim that forked it (Prim::run does).
+//  The size defaults to PSIM_THREADS (1 = no workers). Workers inherit the rank's CPU
+//  affinity, so hybrid runs want a placement that leaves the rank more than one CPU
+//  (PSIM_PLACEMENT=none).
+//
+
+#ifndef __PSIM__threadPool__
+#define __PSIM__threadPool__
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool {
+public:
+
+    ThreadPool(int threads = 0);        //threads <= 0: threads_from_env()
+    ~ThreadPool();
+
+    static int threads_from_env();
+
+    int size() const { return nthreads; }
+
+    void submit(const std::function<void()>& task);
+    void wait();    //for the tasks submitted by the caller (a task, or the thread outside)
+
+    void parallel_for(long long begin, long long end, const std::function<void(long long, long long)>& body, long long grain = 1);
+
+    /*
+     *  combine(identity, body(b0, e0), body(b1, e1), ...) over a split of [begin, end)
+     *  into blocks of at least 'grain'. Blocks are folded in order, so 'combine' only
+     *  has to be associative.
+     */
+    template<typename T, typename Body, typename Combine>
+    T parallel_reduce(long long begin, long long end, T identity, Body body, Combine combine, long long grain = 1) {
+        long long n = end - begin;
+        if(n <= 0) {
+            return identity;
+        }
+        if(nthreads == 1) {
+            return combine(identity, body(begin, end));
+        }
+        long long blocks = std::min((n + grain - 1) / std::max(grain, 1LL), 4LL * nthreads);
+        std::vector<T> partial(blocks, identity);
+        parallel_for(0, blocks, [&](long long b0, long long b1) {
+            for(long long b = b0; b < b1; b++) {
+                partial[b] = body(begin + n * b / blocks, begin + n * (b + 1) / blocks);
+            }
+        });
+        T result = identity;
+        for(long long b = 0; b < blocks; b++) {
+            result = combine(result, partial[b]);
+        }
+        return result;
+    }
+
+private:
+    //A task and the counter of its submitter's unfinished tasks
+    struct Task {
+        std::function<void()> run;
+        std::atomic<long long>* left;
+    };
+
+    struct TaskQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    int slot() const;
+    std::atomic<long long>& scope();
+    void push(const std::function<void()>& task, std::atomic<long long>& left);
+    bool run_one(int self);
+    void finish(std::atomic<long long>& left);
+    void help_until(std::atomic<long long>& left);
+    void work(int self);
+
+    int nthreads;
+    std::vector<TaskQueue*> queues;     //queues[i]: deque of the thread in slot i
+    std::vector<std::thread> workers;
+    std::atomic<long long> queued;      //tasks sitting in a deque
+    std::atomic<long long> unfinished;  //tasks submitted from outside any task, not yet finished
+    std::mutex sleepLock;
+    std::condition_variable wake;       //workers and waiting threads sleep here
+    int parked;                         //threads asleep in help_until (under sleepLock)
+    bool stopping;
+};
+
+#endif /* defined(__PSIM__threadPool__) */